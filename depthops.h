@@ -0,0 +1,315 @@
+#ifndef DEPTHOPS_H
+#define DEPTHOPS_H
+
+/*
+	Helpers for taking the depth cameras' frames into the fields.
+
+	Everything here works per device, on the raw DEPTH_WIDTH x DEPTH_HEIGHT depth image,
+	and on ranges of rows, so that a pass can be split across the WorkerPool.
+	(Like fieldops.h, it expects glm to have been included already.)
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// the depth image of a Kinect v2 (i.e. cDepthWidth x cDepthHeight)
+#define DEPTH_WIDTH 512
+#define DEPTH_HEIGHT 424
+#define DEPTH_PIXELS (DEPTH_WIDTH*DEPTH_HEIGHT)
+
+// masks pack 64 pixels per word, so a row is a whole number of words
+#define DEPTH_MASK_ROW_WORDS (DEPTH_WIDTH/64)
+#define DEPTH_MASK_WORDS (DEPTH_PIXELS/64)
+
+// index of the lowest set bit (bits must not be zero)
+inline int depth_lowest_bit(uint64_t bits) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, bits);
+	return int(i);
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+// which pixels of a depth camera to use, one bit per pixel (set means use it)
+// for the parts of the view that never hold anything useful (walls, furniture, the other camera...)
+struct DepthMask {
+	uint64_t bits[DEPTH_MASK_WORDS];
+
+	void fill(bool use) {
+		memset(bits, use ? 0xff : 0, sizeof(bits));
+	}
+
+	bool get(int i) const {
+		return (bits[i >> 6] >> (i & 63)) & 1;
+	}
+
+	void set(int i, bool use) {
+		const uint64_t bit = uint64_t(1) << (i & 63);
+		bits[i >> 6] = use ? (bits[i >> 6] | bit) : (bits[i >> 6] & ~bit);
+	}
+
+	int count() const {
+		int n = 0;
+		for (int w=0; w<DEPTH_MASK_WORDS; w++) {
+			for (uint64_t b = bits[w]; b; b &= b - 1) n++;
+		}
+		return n;
+	}
+
+	// read a binary (P5) 8-bit greyscale image of DEPTH_WIDTH x DEPTH_HEIGHT, e.g. as painted in an image editor
+	// pixels brighter than mid-grey are used
+	bool load_pgm(const char * path) {
+		FILE * file = fopen(path, "rb");
+		if (!file) return false;
+		int w = 0, h = 0, maxval = 0;
+		bool ok = fgetc(file) == 'P' && fgetc(file) == '5'
+			&& pgm_field(file, w) && pgm_field(file, h) && pgm_field(file, maxval)
+			&& w == DEPTH_WIDTH && h == DEPTH_HEIGHT && maxval > 0 && maxval < 256;
+		if (ok) {
+			// exactly one whitespace character separates the header from the pixels:
+			fgetc(file);
+			static uint8_t grey[DEPTH_PIXELS];
+			ok = fread(grey, 1, DEPTH_PIXELS, file) == DEPTH_PIXELS;
+			if (ok) {
+				for (int i=0; i<DEPTH_PIXELS; i++) set(i, grey[i] > maxval/2);
+			}
+		}
+		fclose(file);
+		return ok;
+	}
+
+	// the next number in a PGM header, skipping whitespace & comments
+	static bool pgm_field(FILE * file, int& value) {
+		int c;
+		while ((c = fgetc(file)) != EOF) {
+			if (c == '#') {
+				while ((c = fgetc(file)) != EOF && c != '\n') {}
+			} else if (c > ' ') {
+				ungetc(c, file);
+				return fscanf(file, "%d", &value) == 1;
+			}
+		}
+		return false;
+	}
+};
+
+// call fn(i) for each used pixel i of the rows [y0, y1), in order
+// masked pixels are skipped a whole word (64 pixels) at a time where possible
+template<typename F>
+inline void depth_mask_foreach(const DepthMask& mask, const int y0, const int y1, F fn) {
+	for (int w = y0*DEPTH_MASK_ROW_WORDS; w < y1*DEPTH_MASK_ROW_WORDS; w++) {
+		for (uint64_t bits = mask.bits[w]; bits; bits &= bits - 1) {
+			fn(w*64 + depth_lowest_bit(bits));
+		}
+	}
+}
+
+// depth points are splatted in DEPTH_BANDS bands of rows, each into its own DepthSplat,
+// and the bands are then merged in order; so the result is the same however the bands were spread over threads
+#define DEPTH_BANDS 16
+
+// a sparse accumulation of values (e.g. heights) per cell of a grid, for taking their (weighted) mean
+// only the cells that were touched are visited when merging & clearing, so it costs nothing where no points fell
+struct DepthSplat {
+	// the sum of value*weight, and of the weights
+	std::vector<float> sum;
+	std::vector<float> count;
+	// cells with a non-zero count, in the order they were first touched
+	std::vector<int> touched;
+
+	void resize(int cells) {
+		sum.assign(cells, 0.f);
+		count.assign(cells, 0.f);
+		touched.clear();
+	}
+
+	// value is already multiplied by its weight w
+	void add(int cell, float value, float w=1.f) {
+		if (count[cell] == 0.f) touched.push_back(cell);
+		sum[cell] += value;
+		count[cell] += w;
+	}
+
+	// add everything in here to total
+	void add_to(DepthSplat& total) const {
+		for (int cell : touched) total.add(cell, sum[cell], count[cell]);
+	}
+
+	// add everything in here to total, and clear this
+	void merge_into(DepthSplat& total) {
+		add_to(total);
+		clear();
+	}
+
+	void clear() {
+		for (int cell : touched) {
+			sum[cell] = 0.f;
+			count[cell] = 0.f;
+		}
+		touched.clear();
+	}
+
+	float mean(int cell) const {
+		return sum[cell] / count[cell];
+	}
+};
+
+// the ray of each pixel of a depth camera, so that a raw depth can be turned into a point in the fields directly:
+// point = origin + depth * dir[i], rather than reading the device's point cloud & transforming every point of it
+// the camera-space rays (per mm of depth) are learned from the point cloud, the first time each pixel has a depth;
+// place() then puts them in field space for a given camera-to-field transform, as separate x/y/z arrays
+struct DepthRays {
+	std::vector<glm::vec3> camera;
+	DepthMask learned;
+	// the device transform the point cloud was taken to be in, when the rays were learned
+	// and how many more frames to wait before learning, after it changed
+	glm::mat4 camera2world;
+	int learn_holdoff;
+	// the transform the field-space rays were placed with, and the camera's position under it
+	glm::mat4 camera2field;
+	glm::vec3 origin;
+	std::vector<float> dx, dy, dz;
+
+	void resize() {
+		camera.assign(DEPTH_PIXELS, glm::vec3(0.f));
+		learned.fill(false);
+		camera2world = glm::mat4(0.f);
+		learn_holdoff = 0;
+		camera2field = glm::mat4(0.f);
+		origin = glm::vec3(0.f);
+		dx.assign(DEPTH_PIXELS, 0.f);
+		dy.assign(DEPTH_PIXELS, 0.f);
+		dz.assign(DEPTH_PIXELS, 0.f);
+	}
+
+	// the device has been (re)calibrated to camera2world: the rays learned under the old transform are wrong,
+	// so learn them all again, but only after holdoff frames (the point clouds of frames captured before the change
+	// were transformed by the old one)
+	void recalibrate(const glm::mat4& m, int holdoff) {
+		camera2world = m;
+		learned.fill(false);
+		learn_holdoff = holdoff;
+	}
+
+	// pixel i has a depth (in mm) of the point camera_point (in camera space)
+	void learn(int i, const glm::vec3 camera_point, const uint16_t depth) {
+		camera[i] = camera_point / float(depth);
+		learned.set(i, true);
+		place(i);
+	}
+
+	// the field-space ray of pixel i, for the current camera2field
+	void place(int i) {
+		const glm::vec3 d = glm::mat3(camera2field) * camera[i];
+		dx[i] = d.x;
+		dy[i] = d.y;
+		dz[i] = d.z;
+	}
+
+	// (re)place the rows [y0, y1), after camera2field has changed
+	void place_rows(int y0, int y1) {
+		for (int i = y0*DEPTH_WIDTH; i < y1*DEPTH_WIDTH; i++) place(i);
+	}
+
+	// pixel i, which must have been learned, at depth (in mm)
+	glm::vec3 point(int i, const uint16_t depth) const {
+		const float d = float(depth);
+		return glm::vec3(origin.x + d*dx[i], origin.y + d*dy[i], origin.z + d*dz[i]);
+	}
+};
+
+// how many of each device's most recent depth frames the temporal filter keeps (odd, so that there is a middle)
+#define DEPTH_HISTORY 5
+
+// a ring of a device's last DEPTH_HISTORY depth frames, for filtering each pixel over time
+struct DepthHistory {
+	std::vector<uint16_t> frames;
+	int next = 0;
+	int count = 0;
+
+	void resize() {
+		frames.assign(size_t(DEPTH_HISTORY)*DEPTH_PIXELS, 0);
+		next = 0;
+		count = 0;
+	}
+
+	void push(const uint16_t * depth) {
+		memcpy(&frames[size_t(next)*DEPTH_PIXELS], depth, sizeof(uint16_t)*DEPTH_PIXELS);
+		next = (next + 1) % DEPTH_HISTORY;
+		if (count < DEPTH_HISTORY) count++;
+	}
+
+	// the per-pixel median of the frames held, for the rows [y0, y1) of out
+	// a zero depth is no reading, and doesn't count; pixels with fewer than min_valid readings are zero (a hole)
+	// a row of every frame is copied side by side and sorted across the frames by a min/max network,
+	// so each step runs along the row without branches, and vectorizes
+	void median_rows(const int y0, const int y1, const int min_valid, uint16_t * out) const {
+		uint16_t s[DEPTH_HISTORY][DEPTH_WIDTH];
+		for (int y=y0; y<y1; y++) {
+			for (int k=0; k<DEPTH_HISTORY; k++) {
+				if (k < count) {
+					memcpy(s[k], &frames[size_t(k)*DEPTH_PIXELS + y*DEPTH_WIDTH], sizeof(s[k]));
+				} else {
+					memset(s[k], 0, sizeof(s[k]));
+				}
+			}
+			// odd-even transposition sort, so that the no-readings gather at the front:
+			for (int pass=0; pass<DEPTH_HISTORY; pass++) {
+				for (int k=pass & 1; k+1<DEPTH_HISTORY; k+=2) {
+					uint16_t * a = s[k];
+					uint16_t * b = s[k+1];
+					for (int x=0; x<DEPTH_WIDTH; x++) {
+						const uint16_t lo = a[x] < b[x] ? a[x] : b[x];
+						const uint16_t hi = a[x] < b[x] ? b[x] : a[x];
+						a[x] = lo;
+						b[x] = hi;
+					}
+				}
+			}
+			uint16_t * row = out + y*DEPTH_WIDTH;
+			// (in uint16_t throughout, so that it vectorizes as widely as the depths do)
+			const uint16_t holes_max = uint16_t(DEPTH_HISTORY - min_valid);
+			for (int x=0; x<DEPTH_WIDTH; x++) {
+				uint16_t holes = 0;
+				for (int k=0; k<DEPTH_HISTORY; k++) holes += s[k][x] == 0;
+				const uint16_t middle = holes + (DEPTH_HISTORY - holes)/2;
+				uint16_t v = 0;
+				for (int k=0; k<DEPTH_HISTORY; k++) v |= (k == middle) ? s[k][x] : 0;
+				row[x] = holes <= holes_max ? v : 0;
+			}
+		}
+	}
+};
+
+// fill the holes (zero depths) of the rows [y0, y1) of depth from the nearest readings within radius pixels along the row
+// the farther of the readings to either side wins: holes mostly open up where the edge of something near
+// shadows the surface behind it, and it is the surface behind that the hole belongs to
+inline void depth_fill_holes_rows(uint16_t * depth, const int y0, const int y1, const int radius) {
+	uint16_t src[DEPTH_WIDTH];
+	for (int y=y0; y<y1; y++) {
+		uint16_t * row = depth + y*DEPTH_WIDTH;
+		memcpy(src, row, sizeof(src));
+		for (int x=0; x<DEPTH_WIDTH; x++) {
+			if (src[x]) continue;
+			uint16_t left = 0, right = 0;
+			for (int d=1; d<=radius && !left && x-d >= 0; d++) left = src[x-d];
+			for (int d=1; d<=radius && !right && x+d < DEPTH_WIDTH; d++) right = src[x+d];
+			row[x] = left > right ? left : right;
+		}
+	}
+}
+
+// the rows [y0, y1) of band b
+inline void depth_band_rows(int b, int& y0, int& y1) {
+	y0 = DEPTH_HEIGHT * b / DEPTH_BANDS;
+	y1 = DEPTH_HEIGHT * (b+1) / DEPTH_BANDS;
+}
+
+#endif // DEPTHOPS_H
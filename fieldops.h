@@ -0,0 +1,860 @@
+#ifndef FIELDOPS_H
+#define FIELDOPS_H
+
+/*
+	Field kernels that work on a sub-range of a field, so that a pass can be split across the WorkerPool.
+
+	3D kernels process the z-slab [z0, z1), with the same toroidal wrapping as the al_field3d_ routines.
+	Where a kernel reads neighbours that another slab may be writing, the driver takes care of ordering.
+
+	Most 3D kernels also take an optional brick map (one byte per FIELD_BRICK^3 block of voxels),
+	and skip over the bricks that are marked inactive. A null map means the whole field is active.
+	2D kernels do the same with tiles of FIELD_TILE^2 cells.
+*/
+
+#include "workers.h"
+#include <assert.h>
+#include <string.h>
+#include <atomic>
+
+#define FIELD_BRICK 8
+
+#define FIELD_TILE 16
+
+// deposits into a field from threads that don't own it (trails, splats, pushes...)
+// each writer appends to a List of its own, with no locking and no writes to the field's cache lines,
+// and publishes the whole list once per tick; the owning stage takes everything published so far
+// at a point of its own choosing in its tick, and applies it to its field there
+template<typename P, typename T>
+struct DepositBuffer {
+	struct Deposit {
+		P norm;		///< where, in normalized field coordinates
+		T value;
+	};
+	typedef std::vector<Deposit> List;
+
+	std::mutex mutex;
+	List pending;	///< published, not yet taken
+	List taken;		///< what the owner took last
+
+	// writer side: hand over a list of deposits (which is left empty, keeping its capacity)
+	void publish(List& list) {
+		if (list.empty()) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.insert(pending.end(), list.begin(), list.end());
+		list.clear();
+	}
+
+	// owner side: everything published since the last take(); valid until the next take()
+	const List& take() {
+		taken.clear();
+		std::lock_guard<std::mutex> lock(mutex);
+		taken.swap(pending);
+		return taken;
+	}
+};
+
+// read-only snapshots of a field, for threads other than its owner (and the renderer)
+// the owner publishes a copy at the end of its tick; readers pin the latest snapshot without locking,
+// and a pinned snapshot is never overwritten, so it stays consistent for as long as it is held
+// with one snapshot being the latest and one per reader held, there is always a free slot
+// for the next publish, as long as no more than SLOTS-2 readers pin the field (which is asserted);
+// a publish that finds no free slot anyway is dropped, and counted
+template<typename T, int SLOTS=4>
+struct PublishedField {
+	std::vector<T> slots[SLOTS];
+	uint32_t epochs[SLOTS];			///< which publish each slot holds
+	std::atomic<int> pins[SLOTS];	///< how many readers hold each slot
+	std::atomic<int> latest;		///< the most recently published slot, or -1
+	uint32_t published = 0;			///< publishes so far (owner only)
+	std::atomic<uint32_t> dropped;	///< publishes that found no free slot
+	std::atomic<int> readers;		///< how many Readers have pinned this field
+
+	PublishedField() : latest(-1), dropped(0), readers(0) {
+		for (int i=0; i<SLOTS; i++) {
+			epochs[i] = 0;
+			pins[i] = 0;
+		}
+	}
+
+	// owner side: copy count elements of src into a slot that no reader holds, and make it the latest
+	// returns false, publishing nothing, if there was no such slot
+	bool publish(const T * src, size_t count) {
+		const int current = latest.load();
+		for (int i=0; i<SLOTS; i++) {
+			if (i == current || pins[i].load() != 0) continue;
+			// (a reader may pin i now, but will see that it isn't the latest, and let go again)
+			slots[i].assign(src, src + count);
+			epochs[i] = ++published;
+			latest.store(i);
+			return true;
+		}
+		dropped++;
+		return false;
+	}
+
+	// holds a pin on one snapshot, until it pins another or is released
+	struct Reader {
+		PublishedField * field = 0;
+		int slot = -1;
+		PublishedField * reads = 0;	///< the field this reader is counted against
+
+		~Reader() {
+			release();
+			if (reads) reads->readers--;
+		}
+
+		// pin the latest snapshot of f (letting go of the one held before)
+		// returns its data, or null if nothing has been published yet
+		const T * pin(PublishedField& f) {
+			release();
+			if (reads != &f) {
+				if (reads) reads->readers--;
+				reads = &f;
+				// more readers than this, and the owner may find every slot pinned:
+				const int n = ++f.readers;
+				assert(n <= SLOTS-2);
+				(void)n;
+			}
+			while (1) {
+				const int s = f.latest.load();
+				if (s < 0) return 0;
+				f.pins[s]++;
+				// still the latest, so the owner can't have been writing it:
+				if (f.latest.load() == s) {
+					field = &f;
+					slot = s;
+					return data();
+				}
+				f.pins[s]--;
+			}
+		}
+
+		void release() {
+			if (field) field->pins[slot]--;
+			field = 0;
+			slot = -1;
+		}
+
+		const T * data() const { return field ? &field->slots[slot][0] : 0; }
+		uint32_t epoch() const { return field ? field->epochs[slot] : 0; }
+	};
+};
+
+// a double-buffered 3D field, like Field3DPod but with a separate size per axis
+// (so that e.g. the fluid can be fine horizontally and coarse vertically)
+// the data is inline, so that it can live in the mmapped State
+template<int DIMX, int DIMY, int DIMZ, typename T=float>
+struct Field3DPodAniso {
+	T data0[DIMX*DIMY*DIMZ];
+	T data1[DIMX*DIMY*DIMZ];
+	int isSwapped = 0;
+
+	glm::ivec3 dim() const { return glm::ivec3(DIMX, DIMY, DIMZ); }
+	size_t length() const { return size_t(DIMX)*DIMY*DIMZ; }
+
+	T * front() { return isSwapped ? data1 : data0; }
+	T * back() { return isSwapped ? data0 : data1; }
+	const T * front() const { return isSwapped ? data1 : data0; }
+	const T * back() const { return isSwapped ? data0 : data1; }
+
+	void swap() { isSwapped = !isSwapped; }
+
+	void reset() {
+		memset((void *)data0, 0, sizeof(data0));
+		memset((void *)data1, 0, sizeof(data1));
+		isSwapped = 0;
+	}
+};
+
+// counter-based random numbers: a hash of (key, counter) rather than a sequence,
+// so that parallel kernels can draw independent numbers per cell without sharing any RNG state
+inline uint32_t hash32(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+// uniform in [0, 1), the n'th draw for key
+inline float hash_uni(uint32_t key, uint32_t n) {
+	return float(hash32(key + n * 0x9e3779b9U) >> 8) * (1.f / 16777216.f);
+}
+
+inline int field_wrap(int i, int dim) {
+	i %= dim;
+	return i < 0 ? i + dim : i;
+}
+
+// how many bricks span a field dimension
+inline int field_bricks(int dim) {
+	return (dim + FIELD_BRICK-1) / FIELD_BRICK;
+}
+
+inline size_t field3d_brick_count(const glm::ivec3 dim) {
+	return size_t(field_bricks(dim.x)) * field_bricks(dim.y) * field_bricks(dim.z);
+}
+
+// how many tiles span a 2D field dimension
+inline int field_tiles(int dim) {
+	return (dim + FIELD_TILE-1) / FIELD_TILE;
+}
+
+// active = seed, grown by one tile in every direction (with wrapping); tdim is in tiles
+inline void field2d_dilate_tiles(const glm::ivec2 tdim, const uint8_t * seed, uint8_t * active) {
+	for (int y=0, i=0; y<tdim.y; y++) {
+		const int ym = field_wrap(y-1, tdim.y), yp = field_wrap(y+1, tdim.y);
+		for (int x=0; x<tdim.x; x++, i++) {
+			const int xm = field_wrap(x-1, tdim.x), xp = field_wrap(x+1, tdim.x);
+			active[i] = seed[ym*tdim.x + xm] | seed[ym*tdim.x + x] | seed[ym*tdim.x + xp]
+				| seed[y*tdim.x + xm] | seed[y*tdim.x + x] | seed[y*tdim.x + xp]
+				| seed[yp*tdim.x + xm] | seed[yp*tdim.x + x] | seed[yp*tdim.x + xp];
+		}
+	}
+}
+
+// index of the brick holding voxel (x, y, z)
+inline size_t field3d_brick_index(const glm::ivec3 dim, int x, int y, int z) {
+	return (size_t(z/FIELD_BRICK) * field_bricks(dim.y) + y/FIELD_BRICK) * field_bricks(dim.x) + x/FIELD_BRICK;
+}
+
+// the bricks along voxel row (y, z), or null if there is no brick map
+inline const uint8_t * field3d_brick_row(const glm::ivec3 dim, const uint8_t * bricks, int y, int z) {
+	if (!bricks) return 0;
+	return bricks + field3d_brick_index(dim, 0, y, z);
+}
+
+// trilinear read at a voxel coordinate, wrapping at the edges
+template<typename T>
+inline T field3d_read_interp(const glm::ivec3 dim, const T * data, const glm::vec3 pos) {
+	const int x = (int)floorf(pos.x), y = (int)floorf(pos.y), z = (int)floorf(pos.z);
+	const float bx = pos.x - x, by = pos.y - y, bz = pos.z - z;
+	const float ax = 1.f - bx, ay = 1.f - by, az = 1.f - bz;
+	const int xi = field_wrap(x, dim.x), yi = field_wrap(y, dim.y), zi = field_wrap(z, dim.z);
+	const size_t plane = dim.x*dim.y;
+	const size_t x0 = xi, x1 = xi+1 < dim.x ? xi+1 : 0;
+	const size_t y0 = yi*dim.x, y1 = (yi+1 < dim.y ? yi+1 : 0)*dim.x;
+	const size_t z0 = zi*plane, z1 = (zi+1 < dim.z ? zi+1 : 0)*plane;
+	return (data[z0+y0+x0]*ax + data[z0+y0+x1]*bx)*(ay*az)
+		 + (data[z0+y1+x0]*ax + data[z0+y1+x1]*bx)*(by*az)
+		 + (data[z1+y0+x0]*ax + data[z1+y0+x1]*bx)*(ay*bz)
+		 + (data[z1+y1+x0]*ax + data[z1+y1+x1]*bx)*(by*bz);
+}
+
+// as field3d_read_interp, also returning the range of the 8 voxels it interpolated between
+template<typename T>
+inline T field3d_read_interp_range(const glm::ivec3 dim, const T * data, const glm::vec3 pos, T& lo, T& hi) {
+	const int x = (int)floorf(pos.x), y = (int)floorf(pos.y), z = (int)floorf(pos.z);
+	const float bx = pos.x - x, by = pos.y - y, bz = pos.z - z;
+	const float ax = 1.f - bx, ay = 1.f - by, az = 1.f - bz;
+	const int xi = field_wrap(x, dim.x), yi = field_wrap(y, dim.y), zi = field_wrap(z, dim.z);
+	const size_t plane = dim.x*dim.y;
+	const size_t x0 = xi, x1 = xi+1 < dim.x ? xi+1 : 0;
+	const size_t y0 = yi*dim.x, y1 = (yi+1 < dim.y ? yi+1 : 0)*dim.x;
+	const size_t z0 = zi*plane, z1 = (zi+1 < dim.z ? zi+1 : 0)*plane;
+	const T c000 = data[z0+y0+x0], c001 = data[z0+y0+x1], c010 = data[z0+y1+x0], c011 = data[z0+y1+x1];
+	const T c100 = data[z1+y0+x0], c101 = data[z1+y0+x1], c110 = data[z1+y1+x0], c111 = data[z1+y1+x1];
+	lo = glm::min(glm::min(glm::min(c000, c001), glm::min(c010, c011)), glm::min(glm::min(c100, c101), glm::min(c110, c111)));
+	hi = glm::max(glm::max(glm::max(c000, c001), glm::max(c010, c011)), glm::max(glm::max(c100, c101), glm::max(c110, c111)));
+	return (c000*ax + c001*bx)*(ay*az)
+		 + (c010*ax + c011*bx)*(by*az)
+		 + (c100*ax + c101*bx)*(ay*bz)
+		 + (c110*ax + c111*bx)*(by*bz);
+}
+
+// one Gauss-Seidel relaxation pass of (1 - diffusion * laplacian) optr = iptr, in place over optr
+// laplacian_weight scales the second difference along each axis, i.e. it is 1/h^2 relative to a cubic voxel
+// (for grids whose cells are not cubes)
+template<typename T, typename S>
+inline void field3d_diffuse_slab(const glm::ivec3 dim, const T * iptr, T * optr, const S diffusion, const int z0, const int z1, const uint8_t * bricks=0, const glm::vec3 laplacian_weight=glm::vec3(1.f)) {
+	const float wx = laplacian_weight.x, wy = laplacian_weight.y, wz = laplacian_weight.z;
+	const S div = S(1.f) / (S(1.f) + diffusion * (2.f*(wx + wy + wz)));
+	const size_t plane = dim.x*dim.y;
+	for (int z=z0; z<z1; z++) {
+		const size_t zc = z*plane, zm = field_wrap(z-1, dim.z)*plane, zp = field_wrap(z+1, dim.z)*plane;
+		for (int y=0; y<dim.y; y++) {
+			const size_t yc = y*dim.x, ym = field_wrap(y-1, dim.y)*dim.x, yp = field_wrap(y+1, dim.y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const size_t xm = x ? x-1 : dim.x-1, xp = x+1 < dim.x ? x+1 : 0;
+					const size_t here = zc + yc + x;
+					optr[here] = (iptr[here] + diffusion * (
+						(optr[zc + yc + xm] + optr[zc + yc + xp]) * wx +
+						(optr[zc + ym + x] + optr[zc + yp + x]) * wy +
+						(optr[zm + yc + x] + optr[zp + yc + x]) * wz)) * div;
+				}
+			}
+		}
+	}
+}
+
+// divergence of the velocity field, as al_field3d_derive_gradient
+// weight scales the difference along each axis (for grids whose cells are not cubes)
+inline void field3d_derive_gradient_slab(const glm::ivec3 dim, const glm::vec3 * velocities, float * gradient, const glm::vec3 weight, const int z0, const int z1, const uint8_t * bricks=0) {
+	const size_t plane = dim.x*dim.y;
+	for (int z=z0; z<z1; z++) {
+		const size_t zc = z*plane, zm = field_wrap(z-1, dim.z)*plane, zp = field_wrap(z+1, dim.z)*plane;
+		for (int y=0; y<dim.y; y++) {
+			const size_t yc = y*dim.x, ym = field_wrap(y-1, dim.y)*dim.x, yp = field_wrap(y+1, dim.y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const size_t xm = x ? x-1 : dim.x-1, xp = x+1 < dim.x ? x+1 : 0;
+					gradient[zc + yc + x] = -0.5f * (
+						weight.x * (velocities[zc + yc + xp].x - velocities[zc + yc + xm].x) +
+						weight.y * (velocities[zc + yp + x].y - velocities[zc + ym + x].y) +
+						weight.z * (velocities[zp + yc + x].z - velocities[zm + yc + x].z));
+				}
+			}
+		}
+	}
+}
+
+// remove the gradient from the velocities, as al_field3d_subtract_gradient
+// weight as for field3d_derive_gradient_slab
+inline void field3d_subtract_gradient_slab(const glm::ivec3 dim, const float * gradient, glm::vec3 * velocities, const glm::vec3 weight, const int z0, const int z1, const uint8_t * bricks=0) {
+	const size_t plane = dim.x*dim.y;
+	for (int z=z0; z<z1; z++) {
+		const size_t zc = z*plane, zm = field_wrap(z-1, dim.z)*plane, zp = field_wrap(z+1, dim.z)*plane;
+		for (int y=0; y<dim.y; y++) {
+			const size_t yc = y*dim.x, ym = field_wrap(y-1, dim.y)*dim.x, yp = field_wrap(y+1, dim.y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const size_t xm = x ? x-1 : dim.x-1, xp = x+1 < dim.x ? x+1 : 0;
+					glm::vec3& v = velocities[zc + yc + x];
+					v.x -= 0.5f * weight.x * (gradient[zc + yc + xp] - gradient[zc + yc + xm]);
+					v.y -= 0.5f * weight.y * (gradient[zc + yp + x] - gradient[zc + ym + x]);
+					v.z -= 0.5f * weight.z * (gradient[zp + yc + x] - gradient[zm + yc + x]);
+				}
+			}
+		}
+	}
+}
+
+// semi-Lagrangian advection of src by velocities (in voxels), as al_field3d_advect
+// rate converts velocities to voxels per step, per axis
+// velocities may be the same array as dst, since each voxel only reads its own velocity
+template<typename T>
+inline void field3d_advect_slab(const glm::ivec3 dim, const glm::vec3 * velocities, const T * src, T * dst, const glm::vec3 rate, const int z0, const int z1, const uint8_t * bricks=0) {
+	for (int z=z0; z<z1; z++) {
+		for (int y=0; y<dim.y; y++) {
+			const size_t row = (size_t(z)*dim.y + y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const size_t i = row + x;
+					const glm::vec3 pos = glm::vec3(float(x), float(y), float(z)) - velocities[i] * rate;
+					dst[i] = field3d_read_interp(dim, src, pos);
+				}
+			}
+		}
+	}
+}
+
+// second half of a MacCormack advection step, after field3d_advect_slab has advected src into forward:
+// trace forward back along the velocities to estimate the error of the first step,
+// remove half of it, and clamp the result to the range of src that the first step interpolated from
+// (the limiter keeps it stable and free of new extrema)
+// velocities may be the same array as dst, since each voxel only reads its own velocity
+template<typename T>
+inline void field3d_advect_maccormack_slab(const glm::ivec3 dim, const glm::vec3 * velocities, const T * src, const T * forward, T * dst, const glm::vec3 rate, const int z0, const int z1, const uint8_t * bricks=0) {
+	for (int z=z0; z<z1; z++) {
+		for (int y=0; y<dim.y; y++) {
+			const size_t row = (size_t(z)*dim.y + y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const size_t i = row + x;
+					const glm::vec3 here = glm::vec3(float(x), float(y), float(z));
+					const glm::vec3 step = velocities[i] * rate;
+					T lo, hi;
+					field3d_read_interp_range(dim, src, here - step, lo, hi);
+					const T reverse = field3d_read_interp(dim, forward, here + step);
+					const T corrected = forward[i] + (src[i] - reverse) * 0.5f;
+					dst[i] = glm::clamp(corrected, lo, hi);
+				}
+			}
+		}
+	}
+}
+
+// for each z in [z0, z1), zmax[z] is the largest displacement (in voxels along any axis) of velocities * rate
+inline void field3d_max_advection_slab(const glm::ivec3 dim, const glm::vec3 * velocities, const glm::vec3 rate, const int z0, const int z1, float * zmax, const uint8_t * bricks=0) {
+	for (int z=z0; z<z1; z++) {
+		float m = 0.f;
+		for (int y=0; y<dim.y; y++) {
+			const glm::vec3 * v = velocities + (size_t(z)*dim.y + y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) {
+					const glm::vec3 d = glm::abs(v[x] * rate);
+					m = glm::max(m, glm::max(d.x, glm::max(d.y, d.z)));
+				}
+			}
+		}
+		zmax[z] = m;
+	}
+}
+
+template<typename T>
+inline void field3d_clamp_slab(const glm::ivec3 dim, T * data, const T lo, const T hi, const int z0, const int z1, const uint8_t * bricks=0) {
+	for (int z=z0; z<z1; z++) {
+		for (int y=0; y<dim.y; y++) {
+			T * row = data + (size_t(z)*dim.y + y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				for (int x=x0; x<x1; x++) row[x] = glm::clamp(row[x], lo, hi);
+			}
+		}
+	}
+}
+
+// copy the inactive bricks of src into dst (or zero them, if src is null), leaving the active ones alone
+// so that a buffer which a sparse pass only partly writes is still whole when it becomes the front
+// (does nothing without a brick map)
+template<typename T>
+inline void field3d_fill_inactive_slab(const glm::ivec3 dim, const T * src, T * dst, const int z0, const int z1, const uint8_t * bricks) {
+	if (!bricks) return;
+	for (int z=z0; z<z1; z++) {
+		for (int y=0; y<dim.y; y++) {
+			const size_t row = (size_t(z)*dim.y + y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				if (src) {
+					memcpy((void *)(dst + row + x0), (const void *)(src + row + x0), sizeof(T)*(x1 - x0));
+				} else {
+					memset((void *)(dst + row + x0), 0, sizeof(T)*(x1 - x0));
+				}
+			}
+		}
+	}
+}
+
+template<typename T, typename S>
+inline void field3d_scale_slab(const glm::ivec3 dim, T * data, const S scale, const int z0, const int z1) {
+	const size_t plane = dim.x*dim.y;
+	for (size_t i=z0*plane; i<z1*plane; i++) {
+		data[i] *= scale;
+	}
+}
+
+// area-average the 2D field src (of size sdim) down to dst (of size ddim), for the dst rows [y0, y1)
+// each dst cell is the mean of the src cells it covers (at least one)
+template<typename T>
+inline void field2d_box_downsample_rows(const glm::ivec2 sdim, const T * src, const glm::ivec2 ddim, T * dst, const int y0, const int y1) {
+	for (int y=y0; y<y1; y++) {
+		const int sy0 = y*sdim.y/ddim.y, sy1 = std::max((y+1)*sdim.y/ddim.y, sy0+1);
+		for (int x=0; x<ddim.x; x++) {
+			const int sx0 = x*sdim.x/ddim.x, sx1 = std::max((x+1)*sdim.x/ddim.x, sx0+1);
+			T sum = T(0.f);
+			for (int sy=sy0; sy<sy1; sy++) {
+				const T * srow = src + size_t(sy)*sdim.x;
+				for (int sx=sx0; sx<sx1; sx++) sum += srow[sx];
+			}
+			dst[size_t(y)*ddim.x + x] = sum * (1.f / float((sy1-sy0)*(sx1-sx0)));
+		}
+	}
+}
+
+// one tap of the (1 2 1)/4 blur
+// with IGNORE_LOWER, a neighbour lower than the centre counts as the centre, i.e. the blur can raise a cell but never lower it
+template<bool IGNORE_LOWER>
+inline float field_blur3_tap(float a, const float c, float b) {
+	if (IGNORE_LOWER) {
+		a = a > c ? a : c;
+		b = b > c ? b : c;
+	}
+	return 0.5f*c + 0.25f*(a + b);
+}
+
+// one line of the blur, clamping at the ends
+// (the ends are done apart, so that the loop in between has no branches and vectorizes)
+template<int N, bool IGNORE_LOWER>
+inline void field_blur3_line(const float * in, float * out) {
+	out[0] = field_blur3_tap<IGNORE_LOWER>(in[0], in[0], in[1]);
+	for (int x=1; x<N-1; x++) {
+		out[x] = field_blur3_tap<IGNORE_LOWER>(in[x-1], in[x], in[x+1]);
+	}
+	out[N-1] = field_blur3_tap<IGNORE_LOWER>(in[N-2], in[N-1], in[N-1]);
+}
+
+// the 3x3 binomial blur of src into dst (DIMX wide, dimy high), for the dst rows [y0, y1), clamping at the edges
+// it is separable, so each src row is blurred along x once, into a ring of three rows that stays in L1,
+// and each dst row is then the blur along y of the three rows around it: one pass through src & dst
+template<int DIMX, bool IGNORE_LOWER>
+inline void field2d_blur3_rows(const int dimy, const float * src, float * dst, const int y0, const int y1) {
+	float ring[3][DIMX];
+	float * above = ring[0];
+	float * centre = ring[1];
+	float * below = ring[2];
+	field_blur3_line<DIMX, IGNORE_LOWER>(src + size_t(std::max(y0-1, 0))*DIMX, above);
+	field_blur3_line<DIMX, IGNORE_LOWER>(src + size_t(y0)*DIMX, centre);
+	for (int y=y0; y<y1; y++) {
+		field_blur3_line<DIMX, IGNORE_LOWER>(src + size_t(std::min(y+1, dimy-1))*DIMX, below);
+		float * out = dst + size_t(y)*DIMX;
+		for (int x=0; x<DIMX; x++) {
+			out[x] = field_blur3_tap<IGNORE_LOWER>(above[x], centre[x], below[x]);
+		}
+		float * t = above;
+		above = centre;
+		centre = below;
+		below = t;
+	}
+}
+
+// passes of field2d_blur3_rows from src into dst, split over the pool by bands of rows
+// tmp (the same size) holds the intermediate passes; src is left untouched
+template<int DIMX>
+inline void field2d_blur3(WorkerPool& pool, const int dimy, const float * src, float * dst, float * tmp, const bool ignore_lower, const int passes) {
+	if (passes < 1) {
+		memcpy(dst, src, sizeof(float)*DIMX*dimy);
+		return;
+	}
+	// ping-pong between dst & tmp, such that the last pass lands in dst:
+	const float * in = src;
+	for (int p=0; p<passes; p++) {
+		float * out = ((passes - p) & 1) ? dst : tmp;
+		pool.parallel_for(0, dimy, [&](int y0, int y1) {
+			if (ignore_lower) {
+				field2d_blur3_rows<DIMX, true>(dimy, in, out, y0, y1);
+			} else {
+				field2d_blur3_rows<DIMX, false>(dimy, in, out, y0, y1);
+			}
+		});
+		in = out;
+	}
+}
+
+// re-orient velocities to follow the land contour, weighted by the baked influence
+// this is make_orthogonal_to() + mix() written out flat, so that it streams through both arrays
+template<typename Boundary>
+inline void fluid_apply_boundary(glm::vec3 * velocities, const Boundary * boundary, const size_t begin, const size_t end) {
+	for (size_t i=begin; i<end; i++) {
+		const Boundary& b = boundary[i];
+		glm::vec3& vel = velocities[i];
+		// remove the component along the normal:
+		glm::vec3 tangent = vel - b.normal * glm::dot(vel, b.normal);
+		// and re-scale to original magnitude (or zero, as safe_normalize would):
+		float tangent2 = glm::dot(tangent, tangent);
+		float rescale = tangent2 > 0.f ? sqrtf(glm::dot(vel, vel) / tangent2) : 0.f;
+		vel += (tangent * rescale - vel) * b.influence;
+	}
+}
+
+// mark the bricks that the solver should visit:
+// those near the land surface or recently occupied, plus a halo of one brick around them
+inline void field3d_update_bricks(const glm::ivec3 dim, const uint8_t * land, const uint32_t * occupied, const uint32_t frame, const uint32_t frames, uint8_t * active) {
+	const glm::ivec3 bdim = glm::ivec3(field_bricks(dim.x), field_bricks(dim.y), field_bricks(dim.z));
+	const size_t count = field3d_brick_count(dim);
+	std::vector<uint8_t> seed(count);
+	for (size_t i=0; i<count; i++) {
+		seed[i] = land[i] || (frame - occupied[i]) <= frames;
+	}
+	for (int z=0, i=0; z<bdim.z; z++) {
+		for (int y=0; y<bdim.y; y++) {
+			for (int x=0; x<bdim.x; x++, i++) {
+				uint8_t a = 0;
+				for (int dz=-1; dz<=1 && !a; dz++) {
+					for (int dy=-1; dy<=1 && !a; dy++) {
+						for (int dx=-1; dx<=1 && !a; dx++) {
+							a = seed[(field_wrap(z+dz, bdim.z)*bdim.y + field_wrap(y+dy, bdim.y))*bdim.x + field_wrap(x+dx, bdim.x)];
+						}
+					}
+				}
+				active[i] = a;
+			}
+		}
+	}
+}
+
+// how many z-slabs to split a field of depth dimz into for field3d_diffuse_slabs
+// an even number, so that even & odd slabs can alternate, and about two per thread
+inline int field3d_slabs(const WorkerPool& pool, int dimz) {
+	int slabs = std::min(pool.concurrency() * 2, dimz);
+	return slabs & ~1;
+}
+
+// parallel version of al_field3d_diffuse
+// Gauss-Seidel within each slab; the even slabs relax first, while the planes of their odd neighbours
+// serve as read-only halos, then the odd slabs relax against the freshly updated even ones
+template<typename T, typename S>
+inline void field3d_diffuse_slabs(WorkerPool& pool, const int slabs, const glm::ivec3 dim, const T * iptr, T * optr, const S diffusion, const int passes, const uint8_t * bricks=0, const glm::vec3 laplacian_weight=glm::vec3(1.f)) {
+	if (slabs < 2) {
+		for (int n=0; n<passes; n++) field3d_diffuse_slab(dim, iptr, optr, diffusion, 0, dim.z, bricks, laplacian_weight);
+		return;
+	}
+	for (int n=0; n<passes; n++) {
+		for (int phase=0; phase<2; phase++) {
+			pool.parallel_for(0, slabs/2, [&](int s0, int s1) {
+				for (int s=s0; s<s1; s++) {
+					int slab = s*2 + phase;
+					field3d_diffuse_slab(dim, iptr, optr, diffusion, dim.z*slab/slabs, dim.z*(slab+1)/slabs, bricks, laplacian_weight);
+				}
+			});
+		}
+	}
+}
+
+// one red-black half-sweep of (1 - diffusion * laplacian) optr = iptr, over the voxels of one colour,
+// where the colour of a voxel is (x+y+z)&1
+// voxels of a colour only read voxels of the other, so any number of slabs can run at once;
+// for this to hold across the wrap, every dimension must be even
+// if iptr is null, optr is its own right-hand side (each sweep is one step of implicit diffusion in place)
+// omega > 1 over-relaxes (SOR), which converges faster; omega = 1 is plain Gauss-Seidel
+// laplacian_weight as for field3d_diffuse_slab
+template<typename T, typename S>
+inline void field3d_diffuse_rb_slab(const glm::ivec3 dim, const T * iptr, T * optr, const S diffusion, const float omega, const int colour, const int z0, const int z1, const uint8_t * bricks=0, const glm::vec3 laplacian_weight=glm::vec3(1.f)) {
+	assert(dim.x % 2 == 0 && dim.y % 2 == 0 && dim.z % 2 == 0);
+	const float wx = laplacian_weight.x, wy = laplacian_weight.y, wz = laplacian_weight.z;
+	const S div = S(1.f) / (S(1.f) + diffusion * (2.f*(wx + wy + wz)));
+	const size_t plane = dim.x*dim.y;
+	const T * rhs = iptr ? iptr : optr;
+	for (int z=z0; z<z1; z++) {
+		const size_t zc = z*plane, zm = field_wrap(z-1, dim.z)*plane, zp = field_wrap(z+1, dim.z)*plane;
+		for (int y=0; y<dim.y; y++) {
+			const size_t yc = y*dim.x, ym = field_wrap(y-1, dim.y)*dim.x, yp = field_wrap(y+1, dim.y)*dim.x;
+			const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+			const int first = (colour + y + z) & 1;
+			for (int x0=0; x0<dim.x; x0+=FIELD_BRICK) {
+				if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+				const int x1 = std::min(x0+FIELD_BRICK, dim.x);
+				// x0 is even (FIELD_BRICK is), so the colour's first voxel in the brick is at x0 + first
+				for (int x=x0+first; x<x1; x+=2) {
+					const size_t xm = x ? x-1 : dim.x-1, xp = x+1 < dim.x ? x+1 : 0;
+					const size_t here = zc + yc + x;
+					const T relaxed = (rhs[here] + diffusion * (
+						(optr[zc + yc + xm] + optr[zc + yc + xp]) * wx +
+						(optr[zc + ym + x] + optr[zc + yp + x]) * wy +
+						(optr[zm + yc + x] + optr[zp + yc + x]) * wz)) * div;
+					optr[here] += (relaxed - optr[here]) * omega;
+				}
+			}
+		}
+	}
+}
+
+// red-black version of field3d_diffuse_slabs: each pass is a red then a black half-sweep,
+// and each half-sweep is split over the pool with no ordering between slabs
+// (every dimension must be even, see field3d_diffuse_rb_slab)
+template<typename T, typename S>
+inline void field3d_diffuse_rb(WorkerPool& pool, const glm::ivec3 dim, const T * iptr, T * optr, const S diffusion, const int passes, const float omega=1.f, const uint8_t * bricks=0, const glm::vec3 laplacian_weight=glm::vec3(1.f)) {
+	assert(dim.x % 2 == 0 && dim.y % 2 == 0 && dim.z % 2 == 0);
+	for (int n=0; n<passes; n++) {
+		for (int colour=0; colour<2; colour++) {
+			pool.parallel_for(0, dim.z, [&](int z0, int z1) {
+				field3d_diffuse_rb_slab(dim, iptr, optr, diffusion, omega, colour, z0, z1, bricks, laplacian_weight);
+			});
+		}
+	}
+}
+
+// two Jacobi iterations of (1 - diffusion * laplacian) x = src, starting from x = src,
+// over the FIELD_TILE^2 tile whose first cell is (x0, y0), into out (FIELD_TILE^2, row-major)
+// reads a halo of 2 cells around the tile (wrapping) into a local block, so it touches src once
+template<typename T, typename S>
+inline void field2d_diffuse_tile2(const glm::ivec2 dim, const T * src, const int x0, const int y0, const S diffusion, T * out) {
+	const int A = FIELD_TILE+4, B = FIELD_TILE+2;
+	const S div = S(1.f) / (S(1.f) + diffusion * 4.f);
+	T a[A*A], b[B*B];
+	for (int j=0; j<A; j++) {
+		const T * row = src + size_t(field_wrap(y0+j-2, dim.y))*dim.x;
+		for (int i=0; i<A; i++) a[j*A + i] = row[field_wrap(x0+i-2, dim.x)];
+	}
+	// first iteration, over the tile plus 1 cell around it:
+	for (int j=0; j<B; j++) {
+		for (int i=0; i<B; i++) {
+			const int c = (j+1)*A + (i+1);
+			b[j*B + i] = (a[c] + diffusion * (a[c-1] + a[c+1] + a[c-A] + a[c+A])) * div;
+		}
+	}
+	// second, over the tile:
+	for (int j=0; j<FIELD_TILE; j++) {
+		for (int i=0; i<FIELD_TILE; i++) {
+			const int c = (j+1)*B + (i+1);
+			out[j*FIELD_TILE + i] = (a[(j+2)*A + (i+2)] + diffusion * (b[c-1] + b[c+1] + b[c-B] + b[c+B])) * div;
+		}
+	}
+}
+
+// Young & van Vliet's recursive (IIR) approximation of a Gaussian blur: a causal then an anti-causal
+// third-order filter along each axis, so the cost per cell does not depend on sigma
+// only accurate for sigma >= RECURSIVE_GAUSSIAN_MIN_SIGMA (in cells); narrower blurs should diffuse instead
+#define RECURSIVE_GAUSSIAN_MIN_SIGMA 0.5f
+
+template<typename S>
+struct RecursiveGaussian {
+	// w[n] = B x[n] + b1 w[n-1] + b2 w[n-2] + b3 w[n-3] (already divided by b0)
+	S B, b1, b2, b3;
+	// how many cells of (wrapped) context to run the filter over before & after a line
+	int pad;
+};
+
+inline void recursive_gaussian_coefficients(float sigma, float& B, float& b1, float& b2, float& b3) {
+	sigma = std::max(sigma, RECURSIVE_GAUSSIAN_MIN_SIGMA);
+	const float q = sigma >= 2.5f ? 0.98711f*sigma - 0.96330f : 3.97156f - 4.14554f*sqrtf(1.f - 0.26891f*sigma);
+	const float q2 = q*q, q3 = q2*q;
+	const float b0 = 1.57825f + 2.44413f*q + 1.4281f*q2 + 0.422205f*q3;
+	b1 = (2.44413f*q + 2.85619f*q2 + 1.26661f*q3) / b0;
+	b2 = -(1.4281f*q2 + 1.26661f*q3) / b0;
+	b3 = (0.422205f*q3) / b0;
+	B = 1.f - (b1 + b2 + b3);
+}
+
+inline int recursive_gaussian_pad(float sigma) {
+	return int(ceilf(4.f*sigma)) + 3;
+}
+
+inline RecursiveGaussian<float> recursive_gaussian(float sigma) {
+	RecursiveGaussian<float> g;
+	recursive_gaussian_coefficients(sigma, g.B, g.b1, g.b2, g.b3);
+	g.pad = recursive_gaussian_pad(sigma);
+	return g;
+}
+
+// a separate sigma per component
+inline RecursiveGaussian<glm::vec3> recursive_gaussian(glm::vec3 sigma) {
+	RecursiveGaussian<glm::vec3> g;
+	for (int i=0; i<3; i++) recursive_gaussian_coefficients(sigma[i], g.B[i], g.b1[i], g.b2[i], g.b3[i]);
+	g.pad = recursive_gaussian_pad(std::max(sigma.x, std::max(sigma.y, sigma.z)));
+	return g;
+}
+
+// how many cells of scratch recursive_gaussian_lines needs for count lines of n cells
+template<typename S>
+inline size_t recursive_gaussian_scratch(const RecursiveGaussian<S>& g, const int n, const int count) {
+	return size_t(n + 2*std::min(g.pad, n)) * count;
+}
+
+// blur count lines of n cells each, in place, wrapping at the ends
+// line k's cells are at data[k + i*stride], so neighbouring lines are neighbours in memory,
+// and the inner loops run along them (e.g. along a row, while filtering down the columns)
+// scratch holds at least recursive_gaussian_scratch(g, n, count) cells
+template<typename T, typename S>
+inline void recursive_gaussian_lines(const RecursiveGaussian<S>& g, T * data, const int n, const size_t stride, const int count, T * scratch) {
+	const int pad = std::min(g.pad, n);
+	const int len = n + 2*pad;
+	T * w = scratch;
+	// causal, starting from a steady state at the first (wrapped) cell:
+	for (int j=0; j<len; j++) {
+		const T * x = data + size_t(field_wrap(j - pad, n))*stride;
+		T * wj = w + size_t(j)*count;
+		if (j < 3) {
+			for (int k=0; k<count; k++) wj[k] = x[k];
+			continue;
+		}
+		const T * w1 = wj - count, * w2 = w1 - count, * w3 = w2 - count;
+		for (int k=0; k<count; k++) {
+			wj[k] = g.B*x[k] + g.b1*w1[k] + g.b2*w2[k] + g.b3*w3[k];
+		}
+	}
+	// anti-causal, in place, from a steady state at the last cell:
+	for (int j=len-4; j>=0; j--) {
+		T * wj = w + size_t(j)*count;
+		const T * w1 = wj + count, * w2 = w1 + count, * w3 = w2 + count;
+		for (int k=0; k<count; k++) {
+			wj[k] = g.B*wj[k] + g.b1*w1[k] + g.b2*w2[k] + g.b3*w3[k];
+		}
+	}
+	for (int i=0; i<n; i++) {
+		const T * wi = w + size_t(i + pad)*count;
+		T * x = data + size_t(i)*stride;
+		for (int k=0; k<count; k++) x[k] = wi[k];
+	}
+}
+
+// how many neighbouring lines recursive_gaussian_lines filters at once
+#define RECURSIVE_GAUSSIAN_CHUNK 64
+// how many rows are filtered at once along x (each transposed into a lane of the inner loops)
+#define RECURSIVE_GAUSSIAN_ROWS 16
+
+// blur the rows [r0, r1) of a field dimx cells wide, in place, wrapping
+// a block of rows at a time is transposed, so that it is filtered like neighbouring columns
+// (with the rows in the lanes of the inner loops) rather than one row at a time
+template<typename T, typename S>
+inline void recursive_gaussian_rows(const RecursiveGaussian<S>& g, T * data, const int dimx, const int r0, const int r1) {
+	std::vector<T> block(size_t(dimx) * RECURSIVE_GAUSSIAN_ROWS);
+	std::vector<T> scratch(recursive_gaussian_scratch(g, dimx, RECURSIVE_GAUSSIAN_ROWS));
+	for (int b0=r0; b0<r1; b0+=RECURSIVE_GAUSSIAN_ROWS) {
+		const int rows = std::min(RECURSIVE_GAUSSIAN_ROWS, r1 - b0);
+		T * rowdata = data + size_t(b0)*dimx;
+		for (int r=0; r<rows; r++) {
+			for (int x=0; x<dimx; x++) block[size_t(x)*rows + r] = rowdata[size_t(r)*dimx + x];
+		}
+		recursive_gaussian_lines(g, &block[0], dimx, rows, rows, &scratch[0]);
+		for (int r=0; r<rows; r++) {
+			for (int x=0; x<dimx; x++) rowdata[size_t(r)*dimx + x] = block[size_t(x)*rows + r];
+		}
+	}
+}
+
+// Gaussian blur of a 2D field in place (wrapping), split over the pool
+// sigma is in cells; S is float or glm::vec3 (a sigma per component)
+template<typename T, typename S>
+inline void field2d_blur_recursive(WorkerPool& pool, const glm::ivec2 dim, T * data, const S sigma) {
+	const RecursiveGaussian<S> g = recursive_gaussian(sigma);
+	// along x, a block of rows at a time:
+	pool.parallel_for(0, dim.y, [&](int y0, int y1) {
+		recursive_gaussian_rows(g, data, dim.x, y0, y1);
+	});
+	// along y, a chunk of columns at a time:
+	const int chunks = (dim.x + RECURSIVE_GAUSSIAN_CHUNK-1) / RECURSIVE_GAUSSIAN_CHUNK;
+	pool.parallel_for(0, chunks, [&](int c0, int c1) {
+		std::vector<T> scratch(recursive_gaussian_scratch(g, dim.y, RECURSIVE_GAUSSIAN_CHUNK));
+		for (int c=c0; c<c1; c++) {
+			const int x0 = c*RECURSIVE_GAUSSIAN_CHUNK, x1 = std::min(x0 + RECURSIVE_GAUSSIAN_CHUNK, dim.x);
+			recursive_gaussian_lines(g, data + x0, dim.y, dim.x, x1 - x0, &scratch[0]);
+		}
+	}, chunks);
+}
+
+// Gaussian blur of a 3D field in place (wrapping), split over the pool
+template<typename T, typename S>
+inline void field3d_blur_recursive(WorkerPool& pool, const glm::ivec3 dim, T * data, const S sigma) {
+	const RecursiveGaussian<S> g = recursive_gaussian(sigma);
+	const size_t plane = size_t(dim.x)*dim.y;
+	// along x, a block of rows at a time:
+	pool.parallel_for(0, dim.y*dim.z, [&](int r0, int r1) {
+		recursive_gaussian_rows(g, data, dim.x, r0, r1);
+	});
+	// along y, each plane a chunk of columns at a time:
+	const int xchunks = (dim.x + RECURSIVE_GAUSSIAN_CHUNK-1) / RECURSIVE_GAUSSIAN_CHUNK;
+	pool.parallel_for(0, dim.z*xchunks, [&](int c0, int c1) {
+		std::vector<T> scratch(recursive_gaussian_scratch(g, dim.y, RECURSIVE_GAUSSIAN_CHUNK));
+		for (int c=c0; c<c1; c++) {
+			const int z = c / xchunks;
+			const int x0 = (c % xchunks)*RECURSIVE_GAUSSIAN_CHUNK, x1 = std::min(x0 + RECURSIVE_GAUSSIAN_CHUNK, dim.x);
+			recursive_gaussian_lines(g, data + z*plane + x0, dim.y, dim.x, x1 - x0, &scratch[0]);
+		}
+	});
+	// along z, a chunk of the xy plane at a time:
+	const int pchunks = int((plane + RECURSIVE_GAUSSIAN_CHUNK-1) / RECURSIVE_GAUSSIAN_CHUNK);
+	pool.parallel_for(0, pchunks, [&](int c0, int c1) {
+		std::vector<T> scratch(recursive_gaussian_scratch(g, dim.z, RECURSIVE_GAUSSIAN_CHUNK));
+		for (int c=c0; c<c1; c++) {
+			const size_t i0 = size_t(c)*RECURSIVE_GAUSSIAN_CHUNK, i1 = std::min(i0 + RECURSIVE_GAUSSIAN_CHUNK, plane);
+			recursive_gaussian_lines(g, data + i0, dim.z, plane, int(i1 - i0), &scratch[0]);
+		}
+	});
+}
+
+#endif // FIELDOPS_H
@@ -15,6 +15,9 @@
 #include "al/al_json.h"
 #include "al/al_opencv.h"
 #include "alice.h"
+#include "workers.h"
+#include "fieldops.h"
+#include "depthops.h"
 #include "state.h"
 
 struct Profiler {
@@ -250,6 +253,9 @@ VBO debugVBO(sizeof(State::debugdots));
 
 #define NUM_PROJECTORS 3
 Projector projectors[NUM_PROJECTORS];
+// projectors [0, NUM_DEPTH_PROJECTORS) are calibrated together with the depth device of the same index
+// (the last is the overhead view)
+#define NUM_DEPTH_PROJECTORS 2
 
 GBuffer gBufferVR;
 GBuffer gBufferProj;
@@ -307,11 +313,13 @@ Profiler profiler;
 
 //// RUNTIME STUFF ///.
 
-std::mutex sim_mutex;
 MetroThread simThread(25);
 MetroThread fieldThread(25);
 MetroThread fluidThread(10);
 MetroThread landThread(10);
+// these poll faster than the Kinects' 30 fps, but only work when a new frame has arrived:
+MetroThread depthFilterThread(60);
+MetroThread ingestThread(60);
 bool isRunning = 1;
 bool teleporting = false;
 
@@ -331,7 +339,15 @@ void fields_update(double dt) {
 
 void land_update(double dt) { 
 	if (Alice::Instance().isSimulating) state->land_update(dt); 
-	state->generate_land_sdf_and_normals();
+	state->land_bake();
+}
+
+void depth_filter(double dt) { 
+	if (Alice::Instance().isSimulating) state->depth_filter(dt); 
+}
+
+void depth_ingest(double dt) { 
+	if (Alice::Instance().isSimulating) state->depth_ingest(dt); 
 }
 
 void sim_update(double dt) { 
@@ -799,8 +815,6 @@ void onFrame(uint32_t width, uint32_t height) {
 	double t = alice.simTime;
 	float dt = alice.fps.dt;
 	float aspect = gBufferVR.dim.x / (float)gBufferVR.dim.y;
-	CloudDevice& kinect0 = alice.cloudDeviceManager.devices[0];
-	CloudDevice& kinect1 = alice.cloudDeviceManager.devices[1];
 
 	if (alice.simTime > 10.) {
 		state->land_rise_rate = 0.03f;
@@ -1062,15 +1076,38 @@ void onFrame(uint32_t width, uint32_t height) {
 		
 		// upload texture data to GPU:
 		//fluidTex.submit(fluid.velocities.dim(), (glm::vec3 *)fluid.velocities.front()[0]);
-		fluidTex.submit(field_dim, state->fluid_velocities.front());
-		emissionTex.submit(field_dim, state->emission_field.front());
+		// (from the published snapshots, and only when their owners have published a new one)
+		static PublishedField<glm::vec3>::Reader fluid_snapshot, emission_snapshot;
+		static PublishedField<glm::vec4>::Reader field_texture_snapshot;
+		static uint32_t fluid_uploaded = 0, emission_uploaded = 0, field_texture_uploaded = 0;
+		if (fluid_snapshot.pin(fluid_published) && fluid_uploaded != fluid_snapshot.epoch()) {
+			fluid_uploaded = fluid_snapshot.epoch();
+			fluidTex.submit(fluid_dim, fluid_snapshot.data());
+		}
+		if (emission_snapshot.pin(emission_published) && emission_uploaded != emission_snapshot.epoch()) {
+			emission_uploaded = emission_snapshot.epoch();
+			emissionTex.submit(field_dim, emission_snapshot.data());
+		}
 		//fungusTex.submit(glm::ivec2(FUNGUS_DIM, FUNGUS_DIM), state->fungus_field.front());
-		fungusTex.submit(glm::ivec2(FUNGUS_DIM, FUNGUS_DIM), &state->field_texture[0]);
+		if (field_texture_snapshot.pin(field_texture_published) && field_texture_uploaded != field_texture_snapshot.epoch()) {
+			field_texture_uploaded = field_texture_snapshot.epoch();
+			fungusTex.submit(glm::ivec2(FUNGUS_DIM, FUNGUS_DIM), field_texture_snapshot.data());
+		}
 		noiseTex.submit(glm::ivec2(FUNGUS_DIM, FUNGUS_DIM), &state->noise_texture[0]);
 		landTex.submit(glm::ivec2(LAND_DIM, LAND_DIM), &state->land[0]);
-		humanTex.submit(glm::ivec2(LAND_DIM, LAND_DIM), &state->human.front()[0]);
+		static PublishedField<float>::Reader human_snapshot;
+		static uint32_t human_uploaded = 0;
+		if (human_snapshot.pin(human_published) && human_uploaded != human_snapshot.epoch()) {
+			human_uploaded = human_snapshot.epoch();
+			humanTex.submit(glm::ivec2(LAND_DIM, LAND_DIM), human_snapshot.data());
+		}
 		distanceTex.submit(sdf_dim, (float *)&state->distance[0]);
-		flowTex.submit(glm::ivec2(512,424), &state->flow[0]);
+		static PublishedField<glm::vec2>::Reader flow_snapshot;
+		static uint32_t flow_uploaded = 0;
+		if (flow_snapshot.pin(flow_published) && flow_uploaded != flow_snapshot.epoch()) {
+			flow_uploaded = flow_snapshot.epoch();
+			flowTex.submit(glm::ivec2(512,424), (const float *)flow_snapshot.data());
+		}
 		
 		//if (alice.cloudDevice->use_colour) {
 			const CloudDevice& cd = alice.cloudDeviceManager.devices[flip];
@@ -1366,12 +1403,58 @@ void onFrame(uint32_t width, uint32_t height) {
 	profiler.log("draw to window", alice.fps.dt);
 
 	if (showFPS) {
-		console.log("fps %f(%f) at %f; fluid %f(%f) sim %f(%f) field %f(%f) land %f (%f) kinect %f %f, rendered creatures %d (alive ants %d boids %d total %d)", alice.fps.fps, alice.fps.fpsPotential, alice.simTime, fluidThread.fps.fps, fluidThread.fps.fpsPotential, simThread.fps.fps, simThread.fps.fpsPotential, fieldThread.fps.fps, fieldThread.fps.fpsPotential, landThread.fps.fps, landThread.fps.fpsPotential, kinect0.fps.fps, kinect1.fps.fps, rendercreaturecount, numants, numboids,livingcreaturecount);
+		std::string kinectfps;
+		for (int k=0; k<DEPTH_DEVICES; k++) {
+			char buf[32];
+			snprintf(buf, sizeof(buf), " %f", alice.cloudDeviceManager.devices[k].fps.fps);
+			kinectfps += buf;
+		}
+		console.log("fps %f(%f) at %f; fluid %f(%f) sim %f(%f) field %f(%f) land %f (%f) kinect%s, rendered creatures %d (alive ants %d boids %d total %d)", alice.fps.fps, alice.fps.fpsPotential, alice.simTime, fluidThread.fps.fps, fluidThread.fps.fpsPotential, simThread.fps.fps, simThread.fps.fpsPotential, fieldThread.fps.fps, fieldThread.fps.fpsPotential, landThread.fps.fps, landThread.fps.fpsPotential, kinectfps.c_str(), rendercreaturecount, numants, numboids,livingcreaturecount);
+		console.log("fluid bricks active %d of %d, cfl %f in %d substeps, quiescent %d (%u ticks skipped)", state->fluid_active_bricks, FLUID_BRICKS, state->fluid_cfl, state->fluid_substeps, state->fluid_quiescent, state->fluid_quiescent_ticks);
+		console.log("field tiles active: fungus %d chemical %d of %d", state->fungus_active_tiles, state->chemical_active_tiles, FUNGUS_TILES);
+		console.log("depth filter %f(%f) ingest %f(%f): %u frames, %u idle polls", depthFilterThread.fps.fps, depthFilterThread.fps.fpsPotential, ingestThread.fps.fps, ingestThread.fps.fpsPotential, state->depth_frames, state->depth_idle_polls);
+		console.log("field stages: fungus %.3fms (%d rows/tick, %d over budget) chemical %.3fms (%d over) emission %.3fms (%d over)", state->fungus_clock.ms, state->fungus_slice_rows, state->fungus_clock.over_budget, state->chemical_clock.ms, state->chemical_clock.over_budget, state->emission_clock.ms, state->emission_clock.over_budget);
+		uint32_t depth_dropped = 0;
+		for (int k=0; k<DEPTH_DEVICES; k++) depth_dropped += depth_published[k].dropped.load();
+		console.log("publishes dropped: chemical %u fungus %u emission %u texture %u fluid %u terrain %u depth %u human %u flow %u", chemical_published.dropped.load(), fungus_published.dropped.load(), emission_published.dropped.load(), field_texture_published.dropped.load(), fluid_published.dropped.load(), fungus_terrain_published.dropped.load(), depth_dropped, human_published.dropped.load(), flow_published.dropped.load());
 		//profiler.dump();
 	}
 }
 
 
+// times the fungus, chemical & emission steps on a scratch copy of the state (the live one is left alone),
+// with every tile forced active and every stage running in full each step (a whole fungus generation at once),
+// so that it measures the worst case rather than whatever happens to be on the land right now
+// it logs the speedup over one thread for 1..maxthreads threads, so it can only show scaling up to this machine's core count
+void benchmark_fields(int maxthreads, int steps) {
+	PublishedField<glm::vec4>::Reader terrain;
+	if (!terrain.pin(fungus_terrain_published)) return;
+	State * scratch = (State *)new char[sizeof(State)];
+	memcpy((void *)scratch, (const void *)state, sizeof(State));
+	double single = 0.;
+	for (int n=1; n<=maxthreads; n++) {
+		workers.start(n-1);
+		Timer timer;
+		timer.measure();
+		for (int s=0; s<steps; s++) {
+			for (int t=0; t<FUNGUS_TILES; t++) {
+				scratch->fungus_tile_cleared[t] = 0;
+				scratch->chemical_tile_touched[t] = scratch->sim_frame.load();
+			}
+			scratch->fungus_generation_begin(terrain.data(), 1.f / scratch->fungus_rate, hash32(s));
+			scratch->fungus_generation_rows(terrain.data(), 0, FUNGUS_TILES_X);
+			scratch->fungus_generation_end();
+			scratch->chemical_step();
+			scratch->emission_step();
+		}
+		double ms = timer.measure() * 1000. / steps;
+		if (n == 1) single = ms;
+		console.log("fields %dx%d: %2d threads %8.3f ms/step, speedup %.2f", FUNGUS_DIM, FUNGUS_DIM, n, ms, single / ms);
+	}
+	delete[] (char *)scratch;
+}
+void benchmark_fluid();
+
 void onKeyEvent(int keycode, int scancode, int downup, bool shift, bool ctrl, bool alt, bool cmd){
 	Alice& alice = Alice::Instance();
 
@@ -1467,6 +1550,15 @@ void onKeyEvent(int keycode, int scancode, int downup, bool shift, bool ctrl, bo
 			if (downup) showFPS = !showFPS;
 			break;
 
+		case GLFW_KEY_B:
+			if (downup) benchmark_fluid();
+			break;
+
+		// M to re-read the depth masks after editing them
+		case GLFW_KEY_M:
+			if (downup) state->load_depth_masks();
+			break;
+
 		default:
 			console.log("keycode: %d scancode: %d press: %d shift %d ctrl %d alt %d cmd %d", keycode, scancode, downup, shift, ctrl, alt, cmd);
 			break;
@@ -1478,12 +1570,23 @@ void onKeyEvent(int keycode, int scancode, int downup, bool shift, bool ctrl, bo
 
 void threads_begin() {
 	console.log("starting threads");
+	// the shared pool for data-parallel passes
+	// (the calling thread also works, hence one less than the number of cores)
+	int numworkers = state->worker_threads > 0 ? state->worker_threads : int(std::thread::hardware_concurrency()) - 1;
+	workers.start(glm::max(numworkers, 0));
+	// so that readers have something to pin from the start:
+	state->fields_publish();
+	state->fluid_publish();
+	human_published.publish(state->human.front(), LAND_TEXELS);
+	flow_published.publish(state->flowsmooth, LAND_TEXELS);
 	// allow threads to run
 	isRunning = true;
 	simThread.begin(sim_update);
 	fieldThread.begin(fields_update);
 	fluidThread.begin(fluid_update);
 	landThread.begin(land_update);
+	depthFilterThread.begin(depth_filter);
+	ingestThread.begin(depth_ingest);
 	console.log("started threads");
 }
 
@@ -1495,9 +1598,70 @@ void threads_end() {
 	fieldThread.end();
 	fluidThread.end();
 	landThread.end();
+	ingestThread.end();
+	depthFilterThread.end();
+	workers.stop();
 	console.log("ended threads");
 }
 
+// time one solver step for grid size DIMX*DIMY*DIMZ at 1..maxthreads threads
+template<int DIMX, int DIMY, int DIMZ>
+void benchmark_fluid_dim(int maxthreads, int steps) {
+	const int voxels = DIMX*DIMY*DIMZ;
+	auto * velocities = new Field3DPodAniso<DIMX, DIMY, DIMZ, glm::vec3>;
+	auto * gradient = new Field3DPodAniso<DIMX, DIMY, DIMZ, float>;
+	std::vector<FluidBoundary> boundary(voxels);
+	const glm::ivec3 dim = velocities->dim();
+	const size_t nbricks = field3d_brick_count(dim);
+	std::vector<uint8_t> landbricks(nbricks), bricks(nbricks);
+	std::vector<uint32_t> occupied(nbricks, 0);
+	velocities->reset();
+	gradient->reset();
+	state->generate_fluid_boundary(dim, &boundary[0], &landbricks[0]);
+	for (int i=0; i<voxels; i++) {
+		velocities->front()[i] = glm::sphericalRand(0.1f);
+	}
+	state->fluid_resample_flow(dim);
+	// sparse domain from the land alone (nothing occupied):
+	const uint8_t * domain = 0;
+	if (state->fluid_sparse) {
+		field3d_update_bricks(dim, &landbricks[0], &occupied[0], state->fluid_occupancy_frames+1, state->fluid_occupancy_frames, &bricks[0]);
+		domain = &bricks[0];
+		int active = 0;
+		for (size_t i=0; i<nbricks; i++) active += bricks[i];
+		console.log("fluid %dx%dx%d: %d of %d bricks active", DIMX, DIMY, DIMZ, active, int(nbricks));
+	}
+
+	double single = 0.;
+	for (int n=1; n<=maxthreads; n++) {
+		workers.start(n-1);
+		// warm up:
+		state->fluid_step(*velocities, *gradient, &boundary[0], domain, 0.1f);
+		Timer timer;
+		timer.measure();
+		for (int s=0; s<steps; s++) {
+			state->fluid_step(*velocities, *gradient, &boundary[0], domain, 0.1f);
+		}
+		double ms = timer.measure() * 1000. / steps;
+		if (n == 1) single = ms;
+		console.log("fluid %dx%dx%d: %2d threads %8.3f ms/step, speedup %.2f", DIMX, DIMY, DIMZ, n, ms, single / ms);
+	}
+	delete velocities;
+	delete gradient;
+}
+
+// print the scaling curve of the fluid solver
+// the simulation threads are paused meanwhile
+void benchmark_fluid() {
+	threads_end();
+	int maxthreads = glm::max(int(std::thread::hardware_concurrency()), 1);
+	benchmark_fluid_dim<32, 32, 32>(maxthreads, 20);
+	benchmark_fluid_dim<64, 64, 64>(maxthreads, 5);
+	benchmark_fluid_dim<FLUID_DIM_X, FLUID_DIM_Y, FLUID_DIM_Z>(maxthreads, 5);
+	benchmark_fields(maxthreads, 10);
+	threads_begin();
+}
+
 void onReset() {
 	threads_end();
 	state->reset();
@@ -1512,6 +1676,14 @@ void State::reset() {
 	memset(state, 0, sizeof(State)); 
 	state = new(state) State;
 
+	for (int k=0; k<DEPTH_DEVICES; k++) {
+		const DepthDeviceConfig& config = depth_device_configs[k];
+		depth_device_location_x[k] = config.location_x;
+		depth_device_location_y[k] = config.location_y;
+		depth_device_rotation[k] = config.rotation;
+		depth_device_weight[k] = config.weight;
+	}
+
 	// how to convert the normalized coordinates of the fluid (0..1) into positions in the world:
 	// this effectively defines the bounds of the fluid in the world:
 	// from transform(field2world(glm::vec3(0.)))
@@ -1632,10 +1804,16 @@ void State::reset() {
 			}
 		}
 	}
-	
-	
-	generate_land_sdf_and_normals();
 #endif
+	// bake the initial land
+	// (the threads are stopped, so the boundary can be swapped in directly)
+	generate_land_sdf_and_normals();
+	land_baked_contour_follow = fluid_contour_follow;
+	land_baked_active_height = fluid_active_height;
+	generate_fluid_boundary(fluid_velocities.dim(), fluid_boundary.back(), fluid_brick_land_back());
+	fluid_boundary.swap();
+	fluid_boundary_ready.store(0);
+	generate_fungus_terrain(human.front());
 
 	if (1) {
 		int div = sqrt(NUM_DEBUGDOTS);
@@ -1702,166 +1880,121 @@ void State::reset() {
 }
 
 void State::update_projector_loc() {
-	Alice& alice = Alice::Instance();
-	// read calibration:
-	CloudDevice& kinect0 = alice.cloudDeviceManager.devices[0];
-	CloudDevice& kinect1 = alice.cloudDeviceManager.devices[1];
-	{
-		console.log("READING JSON!!!");
-		json calibjson;
-		
-		{
-			// read a JSON file
-			std::ifstream calibstr("projector_calibration/realcalib.json");
-			calibstr >> calibjson;
-			calibstr.close();
-		}
-		console.log("DIGGING INTO JSON!!!");
-
-		glm::vec3 pos, cloud_translate;
-		glm::quat orient, cloud_rotate;
-		glm::vec4 frustum;
+	for (int k=0; k<DEPTH_DEVICES; k++) update_depth_device(k);
+}
 
-		if (calibjson.count("position")) {
-			auto j = calibjson["position"];
-			pos = glm::vec3(j.at(0), j.at(1), j.at(2));
-		}
-		if (calibjson.count("quat")) {
-			auto j = calibjson["quat"];
-			// jitter displays as x y z w
-			// glm declares as w x y z
-			orient = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
-		}
-		if (calibjson.count("frustum")) {
-			auto j = calibjson["frustum"];
-			frustum = glm::vec4(j.at(0), j.at(1), j.at(2), j.at(3));
-		}
+// read device k's calibration, and place its point cloud (and its projector, if it has one) in the world
+void State::update_depth_device(int k) {
+	Alice& alice = Alice::Instance();
+	CloudDevice& kinect = alice.cloudDeviceManager.devices[k];
+	const std::string path = depth_device_path(k, "realcalib.json");
 
-		if (calibjson.count("cloud_translate")) {
-			auto j = calibjson["cloud_translate"];
-			cloud_translate = glm::vec3(j.at(0), j.at(1), j.at(2));
-		}
-		if (calibjson.count("cloud_rotate")) {
-			auto j = calibjson["cloud_rotate"];
-			// jitter displays as x y z w
-			// glm declares as w x y z
-			cloud_rotate = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
+	console.log("READING JSON %s", path.c_str());
+	json calibjson;
+	
+	{
+		// read a JSON file
+		std::ifstream calibstr(path);
+		if (!calibstr) {
+			console.log("no calibration at %s", path.c_str());
+			return;
 		}
+		calibstr >> calibjson;
+		calibstr.close();
+	}
 
+	glm::vec3 pos, cloud_translate;
+	glm::quat orient, cloud_rotate;
+	glm::vec4 frustum;
 
-		console.log("pos %f %f %f", pos.x, pos.y, pos.z);
-		console.log("quat %f %f %f %f", orient.x, orient.y, orient.z, orient.w);
-		console.log("frustum %f %f %f %f", frustum.x, frustum.y, frustum.z, frustum.w);
-		console.log("cloud_translate %f %f %f", cloud_translate.x, cloud_translate.y, cloud_translate.z);
-		console.log("cloud_rotate %f %f %f %f", cloud_rotate.x, cloud_rotate.y, cloud_rotate.z, cloud_rotate.w);
-
-		// TODO: determine the projector ground location in real-space
-		auto real_loc = glm::vec3(state->projector1_location_x, 0., state->projector1_location_y);
-		auto rot_mat = glm::rotate(projector1_rotation, glm::vec3(0,1,0));
-
-		projectors[0].orientation = quat_cast(rot_mat) * orient;
-		projectors[0].location = (transform(rot_mat, pos) + real_loc) * state->kinect2world_scale;
-		projectors[0].far_clip = 6.f * state->kinect2world_scale;
-
-		float nearclip = 1.f;
-		projectors[0].frustum_min = glm::vec2(frustum.x, frustum.z) * nearclip;
-		projectors[0].frustum_max = glm::vec2(frustum.y, frustum.w) * nearclip;
-		projectors[0].near_clip = nearclip;
-
-		// sequence is:
-		// 1. apply cloud rotate (i.e. undo the kinect's rotation relative to ground)
-		// 2. apply cloud translate (i.e. undo kinect's position relative to ground)
-		// 3. apply projector loc (i.e. move ground center to desired location)
-		// 4. apply projector rot (i.e. rotate system around ground center)
-		// 5. scale to world
-
-		kinect0.cloudTransform = glm::scale(glm::vec3(state->kinect2world_scale)) 
-			* glm::translate(real_loc) 
-			* rot_mat
-			* glm::translate(cloud_translate) 
-			* glm::mat4_cast(cloud_rotate);
-
-		//kinect0.cloudTransform = glm::scale(glm::vec3(state->kinect2world_scale)) * glm::translate(cloud_translate) * glm::mat4_cast(cloud_rotate);
+	if (calibjson.count("position")) {
+		auto j = calibjson["position"];
+		pos = glm::vec3(j.at(0), j.at(1), j.at(2));
+	}
+	if (calibjson.count("quat")) {
+		auto j = calibjson["quat"];
+		// jitter displays as x y z w
+		// glm declares as w x y z
+		orient = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
+	}
+	if (calibjson.count("frustum")) {
+		auto j = calibjson["frustum"];
+		frustum = glm::vec4(j.at(0), j.at(1), j.at(2), j.at(3));
 	}
 
-	{
-		console.log("READING JSON!!!");
-		json calibjson;
-		
-		{
-			// read a JSON file
-			std::ifstream calibstr("projector_calibration2/realcalib.json");
-			calibstr >> calibjson;
-			calibstr.close();
-		}
-		console.log("DIGGING INTO JSON!!!");
+	if (calibjson.count("cloud_translate")) {
+		auto j = calibjson["cloud_translate"];
+		cloud_translate = glm::vec3(j.at(0), j.at(1), j.at(2));
+	}
+	if (calibjson.count("cloud_rotate")) {
+		auto j = calibjson["cloud_rotate"];
+		// jitter displays as x y z w
+		// glm declares as w x y z
+		cloud_rotate = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
+	}
 
-		glm::vec3 pos, cloud_translate;
-		glm::quat orient, cloud_rotate;
-		glm::vec4 frustum;
+	console.log("pos %f %f %f", pos.x, pos.y, pos.z);
+	console.log("quat %f %f %f %f", orient.x, orient.y, orient.z, orient.w);
+	console.log("frustum %f %f %f %f", frustum.x, frustum.y, frustum.z, frustum.w);
+	console.log("cloud_translate %f %f %f", cloud_translate.x, cloud_translate.y, cloud_translate.z);
+	console.log("cloud_rotate %f %f %f %f", cloud_rotate.x, cloud_rotate.y, cloud_rotate.z, cloud_rotate.w);
+
+	// TODO: determine the projector ground location in real-space
+	auto real_loc = glm::vec3(depth_device_location_x[k], 0., depth_device_location_y[k]);
+	auto rot_mat = glm::rotate(depth_device_rotation[k], glm::vec3(0,1,0));
+
+	if (k < NUM_DEPTH_PROJECTORS) {
+		Projector& projector = projectors[k];
+		projector.orientation = quat_cast(rot_mat) * orient;
+		projector.location = (transform(rot_mat, pos) + real_loc) * kinect2world_scale;
+		projector.far_clip = 6.f * kinect2world_scale;
+
+		float nearclip = 1.f;//0.1f * kinect2world_scale;
+		projector.frustum_min = glm::vec2(frustum.x, frustum.z) * nearclip;
+		projector.frustum_max = glm::vec2(frustum.y, frustum.w) * nearclip;
+		projector.near_clip = nearclip;
+	}
 
-		if (calibjson.count("position")) {
-			auto j = calibjson["position"];
-			pos = glm::vec3(j.at(0), j.at(1), j.at(2));
-		}
-		if (calibjson.count("quat")) {
-			auto j = calibjson["quat"];
-			// jitter displays as x y z w
-			// glm declares as w x y z
-			orient = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
-		}
-		if (calibjson.count("frustum")) {
-			auto j = calibjson["frustum"];
-			frustum = glm::vec4(j.at(0), j.at(1), j.at(2), j.at(3));
-		}
+	// sequence is:
+	// 1. apply cloud rotate (i.e. undo the kinect's rotation relative to ground)
+	// 2. apply cloud translate (i.e. undo kinect's position relative to ground)
+	// 3. apply projector loc (i.e. move ground center to desired location)
+	// 4. apply projector rot (i.e. rotate system around ground center)
+	// 5. scale to world
+
+	kinect.cloudTransform = glm::scale(glm::vec3(kinect2world_scale)) 
+		* glm::translate(real_loc) 
+		* rot_mat
+		* glm::translate(cloud_translate) 
+		* glm::mat4_cast(cloud_rotate);
+}
 
-		if (calibjson.count("cloud_translate")) {
-			auto j = calibjson["cloud_translate"];
-			cloud_translate = glm::vec3(j.at(0), j.at(1), j.at(2));
+// read each device's depth mask image, or use the built-in mask if it has none,
+// and hand them over to the ingest thread (which takes them on its next tick)
+void State::load_depth_masks() {
+	// (into a spare first, so that a half-saved image doesn't replace a working mask)
+	static DepthMask mask;
+	for (int k=0; k<DEPTH_DEVICES; k++) {
+		if (depth_mask_pending[k]) {
+			console.log("depth mask %d: the last one hasn't been taken yet", k);
+			continue;
 		}
-		if (calibjson.count("cloud_rotate")) {
-			auto j = calibjson["cloud_rotate"];
-			// jitter displays as x y z w
-			// glm declares as w x y z
-			cloud_rotate = glm::quat(j.at(3), j.at(0), j.at(1), j.at(2));
+		const std::string path = depth_device_path(k, "depthmask.pgm");
+		FILE * existing = fopen(path.c_str(), "rb");
+		if (existing) {
+			fclose(existing);
+			if (!mask.load_pgm(path.c_str())) {
+				console.log("no usable depth mask at %s", path.c_str());
+				continue;
+			}
+			console.log("depth mask %s: %d of %d pixels used", path.c_str(), mask.count(), DEPTH_PIXELS);
+		} else {
+			depth_mask_default(k, mask);
+			console.log("no depth mask at %s, using the built-in one: %d of %d pixels used", path.c_str(), mask.count(), DEPTH_PIXELS);
 		}
-
-
-		console.log("pos %f %f %f", pos.x, pos.y, pos.z);
-		console.log("quat %f %f %f %f", orient.x, orient.y, orient.z, orient.w);
-		console.log("frustum %f %f %f %f", frustum.x, frustum.y, frustum.z, frustum.w);
-		console.log("cloud_translate %f %f %f", cloud_translate.x, cloud_translate.y, cloud_translate.z);
-		console.log("cloud_rotate %f %f %f %f", cloud_rotate.x, cloud_rotate.y, cloud_rotate.z, cloud_rotate.w);
-
-		
-		// TODO: determine the projector ground location in real-space
-		auto real_loc = glm::vec3(state->projector2_location_x, 0., state->projector2_location_y);
-		auto rot_mat = glm::rotate(projector2_rotation, glm::vec3(0,1,0));
-
-		projectors[1].orientation = quat_cast(rot_mat) * orient;
-		projectors[1].location = (transform(rot_mat, pos) + real_loc) * state->kinect2world_scale;
-		projectors[1].far_clip = 6.f * state->kinect2world_scale;
-
-		float nearclip = 1.f;//0.1f * state->kinect2world_scale;
-		projectors[1].frustum_min = glm::vec2(frustum.x, frustum.z) * nearclip;
-		projectors[1].frustum_max = glm::vec2(frustum.y, frustum.w) * nearclip;
-		projectors[1].near_clip = nearclip;
-
-		// sequence is:
-		// 1. apply cloud rotate (i.e. undo the kinect's rotation relative to ground)
-		// 2. apply cloud translate (i.e. undo kinect's position relative to ground)
-		// 3. apply projector loc (i.e. move ground center to desired location)
-		// 4. scale to world
-
-		kinect1.cloudTransform = glm::scale(glm::vec3(state->kinect2world_scale)) 
-			* glm::translate(real_loc) 
-			* rot_mat
-			* glm::translate(cloud_translate) 
-			* glm::mat4_cast(cloud_rotate);
-
-		//kinect1.cloudTransform = glm::mat4(1.f);
+		depth_masks_loaded[k] = mask;
+		depth_mask_pending[k] = 1;
 	}
-
 }
 
 void test() {
@@ -1900,6 +2033,7 @@ extern "C" {
 
 		// set up projectors:
 		state->update_projector_loc();
+		state->load_depth_masks();
 		{
 			projectors[2].orientation = glm::angleAxis(float(-M_PI/2.), glm::vec3(1,0,0));
 			projectors[2].location = 0.5f * (state->world_min + state->world_max);
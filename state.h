@@ -112,6 +112,21 @@ struct Field2DPod {
 	T data1[DIM*DIM];
 	int isSwapped = 0;
 };
+
+template<int DIMX=32, int DIMY=32, int DIMZ=32, typename T=float>
+struct Field3DPodAniso {
+	T data0[DIMX*DIMY*DIMZ];
+	T data1[DIMX*DIMY*DIMZ];
+	int isSwapped = 0;
+};
+
+// from fieldops.h:
+#define FIELD_BRICK 8
+#define FIELD_TILE 16
+// from depthops.h:
+#define DEPTH_WIDTH 512
+#define DEPTH_HEIGHT 424
+#define DEPTH_PIXELS (DEPTH_WIDTH*DEPTH_HEIGHT)
 #endif
 
 
@@ -191,6 +206,91 @@ glm::quat align_forward_to(glm::quat const q, glm::vec3 const direction) {
 
 
 static int flip = 0;
+// shared by the simulation threads for their data-parallel passes:
+WorkerPool workers;
+// the fluid solver's intermediate advection result (for fluid_advection_mode 1)
+std::vector<glm::vec3> fluid_advect_scratch;
+// set by the land thread when it has baked a new fluid boundary into the back buffer,
+// and cleared by the fluid thread once it has swapped it in (see State::land_bake)
+std::atomic<int> fluid_boundary_ready;
+// the optical flow resampled to the fluid's x/z resolution, as a force per fluid column
+std::vector<glm::vec2> fluid_flow_force;
+// deposits into the fields owned by the field & fluid threads
+// the sim thread fills its own lists during its tick and publishes them at the end of it;
+// each owner merges them at the start of its stage
+DepositBuffer<glm::vec2, glm::vec3> chemical_deposits;
+DepositBuffer<glm::vec3, glm::vec3> emission_deposits;
+DepositBuffer<glm::vec3, glm::vec3> fluid_deposits;
+DepositBuffer<glm::vec2, float> fungus_deposits;
+DepositBuffer<glm::vec2, glm::vec3>::List sim_chemical_deposits;
+DepositBuffer<glm::vec3, glm::vec3>::List sim_emission_deposits;
+DepositBuffer<glm::vec3, glm::vec3>::List sim_fluid_deposits;
+DepositBuffer<glm::vec2, float>::List sim_fungus_deposits;
+// snapshots of the fields, published by their owners at the end of each tick
+// the sim thread and the renderer read these, never the buffers that are being worked on
+PublishedField<glm::vec3> chemical_published;
+PublishedField<float> fungus_published;
+PublishedField<glm::vec3> emission_published;
+PublishedField<glm::vec4> field_texture_published;
+PublishedField<glm::vec3> fluid_published;
+// the fungus terrain, published by the land thread, and as held by the field thread for the current CA generation
+PublishedField<glm::vec4> fungus_terrain_published;
+PublishedField<glm::vec4>::Reader fungus_generation_terrain;
+// the snapshots the sim thread is reading this tick:
+PublishedField<glm::vec3>::Reader sim_chemicals;
+PublishedField<float>::Reader sim_fungus;
+PublishedField<glm::vec3>::Reader sim_fluid;
+// the Kinects, i.e. cloudDeviceManager.devices[0, DEPTH_DEVICES)
+// the first NUM_DEPTH_PROJECTORS of them share a calibration with the projector of the same index
+#define DEPTH_DEVICES 2
+struct DepthDeviceConfig {
+	// the directory holding its calibration (realcalib.json, see State::update_depth_device)
+	// and its depth mask (depthmask.pgm, see State::load_depth_masks)
+	const char * dir;
+	// the defaults of its State::depth_device_* settings
+	float location_x, location_y, rotation, weight;
+};
+static const DepthDeviceConfig depth_device_configs[] = {
+	{ "projector_calibration",  4.35f, 6.95f, 0.f, 1.f },
+	{ "projector_calibration2", 2.2f,  3.1f,  float(M_PI * 0.508), 1.f },
+};
+static_assert(sizeof(depth_device_configs)/sizeof(depth_device_configs[0]) == DEPTH_DEVICES, "one DepthDeviceConfig per depth device");
+static std::string depth_device_path(int k, const char * file) {
+	return std::string(depth_device_configs[k].dir) + "/" + file;
+}
+// which depth pixels of each Kinect to use (owned by the ingest thread)
+DepthMask depth_masks[DEPTH_DEVICES];
+// masks loaded by the main thread (see State::load_depth_masks), waiting for the ingest thread to take them
+DepthMask depth_masks_loaded[DEPTH_DEVICES];
+std::atomic<int> depth_mask_pending[DEPTH_DEVICES];
+// the human heights splatted by each band of depth rows, merged into each device's latest frame,
+// and all devices' fused
+DepthSplat depth_splats[DEPTH_BANDS];
+DepthSplat depth_device_splats[DEPTH_DEVICES];
+DepthSplat depth_splat_total;
+// the frame of each device that was filtered last
+// (a device's cloudFrame() moves to another slot of its ring when a new frame arrives)
+const CloudFrame * depth_last_frame[DEPTH_DEVICES];
+// each device's recent depth frames, and the result of filtering them (for the device being filtered)
+DepthHistory depth_history[DEPTH_DEVICES];
+std::vector<uint16_t> depth_filtered;
+// each device's filtered depths, published by the depth filter stage for the ingestion stage
+PublishedField<uint16_t> depth_published[DEPTH_DEVICES];
+// the filtered depths as ingestion is reading them, and the epoch of those it took in last:
+PublishedField<uint16_t>::Reader depth_ingest_frames[DEPTH_DEVICES];
+uint32_t depth_ingested_epoch[DEPTH_DEVICES];
+// the filtered human field, and the intermediate passes of the filter
+std::vector<float> human_filtered;
+std::vector<float> human_filter_scratch;
+// the human field, published by the ingestion stage whenever it has taken in a new frame
+PublishedField<float> human_published;
+// the smoothed optical flow of the human field, published along with it, and as the fluid thread is reading it
+PublishedField<glm::vec2> flow_published;
+PublishedField<glm::vec2>::Reader fluid_flow;
+// the ray of each depth pixel, per device:
+DepthRays depth_rays[DEPTH_DEVICES];
+// the human field as the land thread is reading it this tick:
+PublishedField<float>::Reader land_human;
 int rendercreaturecount = 0;
 int livingcreaturecount = 0;
 int numants = 0;
@@ -211,6 +311,16 @@ int numboids = 0;
 #define FIELD_TEXELS (FIELD_DIM*FIELD_DIM)
 #define FIELD_VOXELS (FIELD_DIM*FIELD_DIM*FIELD_DIM)
 
+// the fluid grid covers the same world box as the fields, but finer horizontally than vertically
+// each axis must be a multiple of FIELD_BRICK
+#define FLUID_DIM_X 128
+#define FLUID_DIM_Y 24
+#define FLUID_DIM_Z 128
+#define FLUID_VOXELS (FLUID_DIM_X*FLUID_DIM_Y*FLUID_DIM_Z)
+#define FLUID_BRICKS ((FLUID_DIM_X/FIELD_BRICK)*(FLUID_DIM_Y/FIELD_BRICK)*(FLUID_DIM_Z/FIELD_BRICK))
+// the grid size that the fluid parameters (fluid_advection etc.) were tuned for
+#define FLUID_REFERENCE_DIM 32
+
 
 #define LAND_DIM 256
 #define LAND_TEXELS (LAND_DIM*LAND_DIM)
@@ -225,18 +335,22 @@ int numboids = 0;
 
 #define FUNGUS_DIM 512
 #define FUNGUS_TEXELS (FUNGUS_DIM*FUNGUS_DIM)
+#define FUNGUS_TILES_X (FUNGUS_DIM/FIELD_TILE)
+#define FUNGUS_TILES (FUNGUS_TILES_X*FUNGUS_TILES_X)
 
-// defined to be at least enough to visualize two kinects:
-#define NUM_DEBUGDOTS (512*424*2)
+// defined to be at least enough to visualize all the kinects:
+#define NUM_DEBUGDOTS (DEPTH_PIXELS*DEPTH_DEVICES)
 //2*5*4
 
 static const glm::ivec3 field_dim = glm::ivec3(FIELD_DIM, FIELD_DIM, FIELD_DIM);
+static const glm::ivec3 fluid_dim = glm::ivec3(FLUID_DIM_X, FLUID_DIM_Y, FLUID_DIM_Z);
 static const glm::ivec3 land_dim = glm::ivec3(LAND_DIM, LAND_DIM, LAND_DIM);
 static const glm::ivec3 sdf_dim = glm::ivec3(SDF_DIM, SDF_DIM, SDF_DIM);
 
 static const glm::ivec2 field_dim2 = glm::ivec2(FIELD_DIM, FIELD_DIM);
 static const glm::ivec2 land_dim2 = glm::ivec2(LAND_DIM, LAND_DIM);
 static const glm::ivec2 fungus_dim = glm::ivec2(FUNGUS_DIM, FUNGUS_DIM);
+static const glm::ivec2 fungus_tile_dim = glm::ivec2(FUNGUS_TILES_X, FUNGUS_TILES_X);
 
 struct Creature {
 	enum {
@@ -339,6 +453,60 @@ struct DebugDot {
 	float unused;
 };
 
+// how a fluid voxel couples to the landscape
+// only changes when the land SDF is regenerated, so it is baked per voxel
+struct FluidBoundary {
+	// the land normal (gradient of the SDF) at this voxel
+	glm::vec3 normal;
+	// 0..1, how strongly the flow is re-oriented to follow the land here
+	float influence;
+	// non-zero if this voxel is below the land surface
+	int32_t underground;
+};
+
+// scheduling & telemetry of one stage of a thread's tick, e.g. the fungus CA within fields_update
+// the stage runs whenever 1/rate seconds have accumulated, with all of that time as its dt
+struct StageClock {
+	// simulated time since the stage last ran
+	float due;
+	// smoothed cost of a run, in ms
+	float ms;
+	int32_t runs;
+	// runs that took longer than their budget
+	int32_t over_budget;
+
+	// accumulate dt; true if the stage is due to run
+	bool due_at(float dt, float rate) {
+		advance(dt);
+		return is_due(dt, rate);
+	}
+
+	// accumulate dt (every tick, including those in which a run can't start)
+	void advance(float dt) { due += dt; }
+
+	// true if the stage is due to run, on a tick of length dt
+	// (half a tick early rather than a whole tick late, so it keeps up with a thread ticking at the same rate)
+	bool is_due(float dt, float rate) const {
+		return due + 0.5f*dt >= 1.f/rate;
+	}
+
+	// the dt of a run starting now
+	float begin() {
+		float dt = due;
+		due = 0.f;
+		return dt;
+	}
+
+	// record the cost of a run; true if it was over budget
+	bool end(float run_ms, float budget_ms) {
+		ms = runs ? glm::mix(ms, run_ms, 0.1f) : run_ms;
+		runs++;
+		bool over = run_ms > budget_ms;
+		over_budget += over;
+		return over;
+	}
+};
+
 struct AudioState {
 	struct Frame {
 		// 0 = Dead, 0.1-0.4 = species type
@@ -387,6 +555,7 @@ struct State {
 
 	// the flow field (hopefully this isn't too high res)
 	// Paris ran at 128 x 64, for example
+	// (owned by the ingestion stage, which publishes flowsmooth as flow_published)
 	glm::vec2 flow[LAND_TEXELS];
 	glm::vec2 flowsmooth[LAND_TEXELS];
 
@@ -405,13 +574,82 @@ struct State {
 	Field2DPod<FUNGUS_DIM, glm::vec3> chemical_field;
 	// the fungus + chemicals combined into a temporally-smoothed texture
 	glm::vec4 field_texture[FUNGUS_TEXELS];
+	// per fungus cell, derived from land & human by the land thread, and published to the field thread:
+	// x: land height above the coastline, y: human height above the land (both in meters)
+	// z: 1 for lowland cells that the fungus must leave vacant, else 0
+	glm::vec4 fungus_terrain[FUNGUS_TEXELS];
+	// counts fungus CA ticks; seeds its random numbers
+	uint32_t fungus_tick;
+	// a CA generation may be spread over several field ticks (see fungus_stage):
+	// the next tile row to process (0 when no generation is under way), and the generation's seed & dt
+	int fungus_slice;
+	uint32_t fungus_generation_seed;
+	float fungus_generation_dt;
+	// how many tile rows to process per field tick, adapted to fungus_budget_ms
+	int fungus_slice_rows = FUNGUS_TILES_X;
+	StageClock fungus_clock;
+	StageClock chemical_clock;
+	StageClock emission_clock;
+	// activity of the 2D fields, per FIELD_TILE^2 tile:
+	// every cell of the tile is forced vacant (ocean or lowland) in the terrain of the current CA generation
+	uint8_t fungus_tile_vacant[FUNGUS_TILES];
+	// how many ticks in a row the tile has been vacant (up to 2)
+	// from 1 the fungus front is all zero there, from 2 the back is too, and the CA skips the tile
+	uint8_t fungus_tile_cleared[FUNGUS_TILES];
+	// the sim_frame of the last chemical deposit in the tile (written by the field thread, as it takes in the deposits)
+	uint32_t chemical_tile_touched[FUNGUS_TILES];
+	// the chemicals in the tile are not all zero
+	uint8_t chemical_tile_live[FUNGUS_TILES];
+	// the tiles the chemical pass visits this tick (live or touched, plus a halo)
+	uint8_t chemical_tile_active[FUNGUS_TILES];
+	// field_texture is all zero over the tile
+	uint8_t texture_tile_zero[FUNGUS_TILES];
+	int fungus_active_tiles;
+	int chemical_active_tiles;
+	// depth ingestion: the human field's updates, and the age of each device's latest splat (in seconds)
+	StageClock human_clock;
+	float depth_splat_age[DEPTH_DEVICES];
+	// depth filtering: frames filtered, and polls that found nothing new
+	uint32_t depth_frames;
+	uint32_t depth_idle_polls;
 	
 	// a baked grid of randomness over the landscape:
 	glm::vec4 noise_texture[FUNGUS_TEXELS];
 
 	// the fluid simulation:
-	Field3DPod<FIELD_DIM, glm::vec3> fluid_velocities;
-	Field3DPod<FIELD_DIM, float> fluid_gradient;
+	Field3DPodAniso<FLUID_DIM_X, FLUID_DIM_Y, FLUID_DIM_Z, glm::vec3> fluid_velocities;
+	Field3DPodAniso<FLUID_DIM_X, FLUID_DIM_Y, FLUID_DIM_Z, float> fluid_gradient;
+	// land coupling per fluid voxel, written by the land thread (back) and read by the fluid thread (front)
+	// (the fluid thread does the swap, see land_bake)
+	Field3DPodAniso<FLUID_DIM_X, FLUID_DIM_Y, FLUID_DIM_Z, FluidBoundary> fluid_boundary;
+	// the sum of the land's largest movement per tick since it was last baked, and since the fungus terrain was last derived
+	// (land thread only)
+	float land_drift;
+	float fungus_terrain_drift;
+	// the fluid_contour_follow & fluid_active_height that the fluid boundary was last baked with
+	float land_baked_contour_follow;
+	float land_baked_active_height;
+	// sparse solver domain, one byte per FIELD_BRICK^3 voxels:
+	// bricks near the land surface, double-buffered along with fluid_boundary
+	// (see fluid_brick_land_front/back)
+	uint8_t fluid_brick_land[2][FLUID_BRICKS];
+	// the sim_frame in which a creature last pushed the fluid in the brick (written by the fluid thread)
+	uint32_t fluid_brick_occupied[FLUID_BRICKS];
+	// the bricks the solver visits this step, with a halo (written by the fluid thread)
+	uint8_t fluid_bricks[FLUID_BRICKS];
+	int fluid_active_bricks;
+	// counted by the sim thread, read by the field & fluid threads
+	std::atomic<uint32_t> sim_frame;
+	// converts fluid velocities to world meters per second at the fluid thread's current rate
+	float fluid_world_speed;
+	// the last step's CFL number (voxels per advection step) and how many substeps it took
+	float fluid_cfl;
+	int fluid_substeps;
+	// quiescence: set when the fluid has been calm for a while, and the solver only decays it
+	int fluid_quiescent;
+	int fluid_calm_ticks;
+	// how many fluid ticks have been skipped so far
+	uint32_t fluid_quiescent_ticks;
 
 	glm::vec3 teleport_points[NUM_TELEPORT_POINTS];
 
@@ -434,18 +672,46 @@ struct State {
 
 	// parameters:
 
+	// threads in the shared worker pool (0 means one per core)
+	int worker_threads = 0;
+
 	int fluid_passes = 14;
+	// 1: diffuse with red-black Gauss-Seidel sweeps, which converge in about half the passes
+	// (so the fluid uses half of fluid_passes), and let emission diffuse in place
+	// 0: Gauss-Seidel over alternating slabs
+	int diffuse_red_black = 1;
+	// over-relaxation of the red-black sweeps (1 is plain Gauss-Seidel; must stay below 2)
+	float diffuse_sor = 1.2f;
 	int fluid_noise_count = 32;
 	float fluid_decay = 0.9999; //0.999999f;
 	double fluid_viscosity = 0.00001;
 	double fluid_boundary_damping = .2;
 	double fluid_noise = 8.;
 	float fluid_advection = 0.25;
+	// 0: semi-Lagrangian advection; 1: MacCormack (second order, with limiter)
+	int fluid_advection_mode = 0;
+	// advection is split into substeps of at most this many voxels:
+	float fluid_cfl_max = 1.f;
+	// but never more substeps than this; beyond it the fastest velocities are clamped
+	int fluid_substeps_max = 4;
+	// the fluid goes quiescent (decay only) after this many ticks in which no voxel advected further than fluid_calm_cfl voxels
+	float fluid_calm_cfl = 0.01f;
+	int fluid_calm_ticks_to_sleep = 50;
+	// and wakes as soon as the optical flow force (after fluid_flow_min_threshold) or a single creature push exceeds these,
+	// or the pushes merged while it slept have made any voxel move further than fluid_calm_cfl
+	float fluid_wake_flow = 0.f;
+	float fluid_wake_push = 0.25f;
 	float fluid_contour_follow =  0.001f;
+	// only solve the fluid in bricks near the land or near creatures:
+	int fluid_sparse = 1;
+	// how far above the land (in normalized field units) bricks stay active
+	float fluid_active_height = 0.125f;
+	// how many sim frames a brick stays active after a creature last pushed the fluid in it
+	int fluid_occupancy_frames = 8;
 
 	float creature_fluid_push = 1.f;
 
-	// running averaging of the optical flow:
+	// running averaging of the optical flow (how far it moves towards each new flow, per 1/30 s):
 	float flow_smoothing = 1.f;
 	// how much the optical flow impacts the fluid:
 	float flow_scale = 0.2f;
@@ -453,26 +719,46 @@ struct State {
 	float fluid_flow_min_threshold = 1.f;
 	
 
+	// how often (Hz) & within what budget (ms per field tick) each stage of fields_update runs
+	// the fungus changes slowly, so its generations come less often, and are spread over several ticks;
+	// chemical & emission decay/diffusion are per run, so changing their rates changes their time scale
+	float fungus_rate = 5.f;
+	float fungus_budget_ms = 2.f;
+	float chemical_rate = 25.f;
+	float chemical_budget_ms = 4.f;
+	float emission_rate = 25.f;
+	float emission_budget_ms = 1.f;
+
 	float emission_decay = 0.9f;
 	glm::vec3 emission_diffuse = glm::vec3(0.01); // somwhere between 0.1 and 0.01 seems to be good
 	float emission_scale = 0.9;
 
 	glm::vec3 chemical_decay = glm::vec3(0.98f);
 	glm::vec3 chemical_diffuse = glm::vec3(0.0001);
+	// a tile whose chemicals all fall below this is zeroed and left alone until something is deposited nearby
+	float chemical_zero_threshold = 0.0001f;
+	// how many sim frames a deposit keeps its tile active
+	int chemical_touch_frames = 4;
 
 	glm::vec3 blood_color = glm::vec3(1., 0.361, 0.172) * 3.0f; 
 	glm::vec3 food_color = glm::vec3(0.64, 0.23, 0.34); 
 	glm::vec3 nest_color = glm::vec3(0.25, 1., 0.75); 
 
-	float projector1_location_x = 4.35;
-	float projector1_location_y = 6.95;
-	float projector1_rotation = 0.f;
-	float projector2_location_x = 2.2;
-	float projector2_location_y = 3.1;
-	float projector2_rotation = M_PI * 0.508;
+	// per depth device (set from depth_device_configs by reset):
+	// where the ground centre of its calibration sits in the sandbox (in meters),
+	// and its rotation around the vertical, as applied by update_depth_device
+	float depth_device_location_x[DEPTH_DEVICES];
+	float depth_device_location_y[DEPTH_DEVICES];
+	float depth_device_rotation[DEPTH_DEVICES];
+	// how much each device's points count where their views overlap (relative to the others')
+	float depth_device_weight[DEPTH_DEVICES];
 
 	float land_fall_rate = 20.f;
 	float land_rise_rate = 1.f;
+	// the land is only re-baked (SDF, normals & fluid boundary) once some cell has moved by more than this (in field units)
+	float land_bake_threshold = 0.25f / SDF_DIM;
+	// and the fungus terrain is only derived again once some cell has moved by more than this (in meters)
+	float fungus_terrain_threshold = 0.01f;
 
 	float vrFade = 0.f;
 	float creature_speed = 3.f; // in object-size per second
@@ -510,6 +796,22 @@ struct State {
 	float predator_view_range = 8.f;
 
 	float human_height_decay = 0.99;
+	// how far the human field moves towards the depth points per 1/30 s (a Kinect's frame period)
+	float human_height_blend = 0.4f;
+	// how often the devices' latest splats are fused into the human field (which decays meanwhile, and is published)
+	float human_update_rate = 30.f;
+	// how long a device's latest splat still counts, in seconds (so that a stalled device doesn't hold its people in place)
+	float depth_splat_max_age = 0.1f;
+	// how the published human field is smoothed: 0: not at all; 1: 3x3 blur; 2: 3x3 blur ignoring neighbours lower than the centre
+	// (mode 2 fills single-pixel dropouts without pulling the edges of people & hands down)
+	int human_filter_mode = 2;
+	int human_filter_passes = 1;
+	// how depth frames are filtered before ingestion: 0: not at all; 1: median over the last DEPTH_HISTORY frames
+	// a pixel needs at least depth_filter_min_valid readings among them, and holes are then filled
+	// from readings up to depth_hole_radius pixels away along the row (0 for none)
+	int depth_filter_mode = 1;
+	int depth_filter_min_valid = 2;
+	int depth_hole_radius = 4;
 	float coastline_height = 10.f;
 
 	// main thread:
@@ -607,373 +909,664 @@ struct State {
 		// 			state->flow[i].y); 
 		// 		push = push * (flow_scale * dt);
 
-		// 		al_field3d_addnorm_interp(field_dim, fluid_velocities.front(), norm, push);
+		// 		al_field3d_addnorm_interp(fluid_dim, fluid_velocities.front(), norm, push);
 		// 	}
 		// }
 		
 		const glm::ivec3 dim = fluid_velocities.dim();
-		const glm::vec3 field_dimf = glm::vec3(field_dim);
-		// diffuse the velocities (viscosity)
-		fluid_velocities.swap();
-		al_field3d_diffuse(dim, fluid_velocities.back(), fluid_velocities.front(), glm::vec3(fluid_viscosity), fluid_passes);
+		// however many substeps it takes, one fluid_step advects by fluid_advection (in 32^3 voxels),
+		// so this converts fluid velocities into meters per second:
+		fluid_world_speed = fluid_advection * (field2world_scale / FLUID_REFERENCE_DIM) / glm::max(dt, 0.001f);
+
+		// a new land boundary?
+		fluid_take_boundary();
+
+		// is anything stirring the fluid?
+		const float flow_peak = fluid_resample_flow(dim);
+		const float push_peak = fluid_merge_deposits();
+		if (flow_peak > fluid_wake_flow || push_peak > fluid_wake_push) {
+			fluid_quiescent = 0;
+			fluid_calm_ticks = 0;
+		}
+		if (fluid_quiescent) {
+			// nothing to solve; just let what is left die away,
+			// while watching whether the pushes merged while asleep have added up to more than a calm fluid:
+			const glm::vec3 advection = fluid_advection * glm::vec3(dim) / float(FLUID_REFERENCE_DIM);
+			std::vector<float> zmax(dim.z);
+			workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+				field3d_scale_slab(dim, fluid_velocities.front(), glm::vec3(fluid_decay), z0, z1);
+				field3d_max_advection_slab(dim, fluid_velocities.front(), advection, z0, z1, &zmax[0]);
+			});
+			float cfl = 0.f;
+			for (int z=0; z<dim.z; z++) cfl = glm::max(cfl, zmax[z]);
+			fluid_cfl = cfl;
+			if (cfl < fluid_calm_cfl) {
+				fluid_quiescent_ticks++;
+				fluid_publish();
+				return;
+			}
+			// solve it from this tick on:
+			fluid_quiescent = 0;
+			fluid_calm_ticks = 0;
+		}
 
+		const uint8_t * bricks = 0;
+		if (fluid_sparse) {
+			field3d_update_bricks(dim, fluid_brick_land_front(), fluid_brick_occupied, sim_frame.load(), fluid_occupancy_frames, fluid_bricks);
+			int count = 0;
+			for (int i=0; i<FLUID_BRICKS; i++) count += fluid_bricks[i];
+			fluid_active_bricks = count;
+			bricks = fluid_bricks;
+		} else {
+			fluid_active_bricks = FLUID_BRICKS;
+		}
 		
-		// apply boundary effect to the velocity field
-		// boundary effect is the landscape, forcing the fluid to align to it when near
-		{
-			float minspeed = 100000.f;
-			float avgspeed = 0.f;
-			float maxspeed = 0.f;
-			
-			int i = 0;
-			glm::vec3 * velocities = fluid_velocities.front();
-			for (size_t z = 0; z<field_dim.z; z++) {
-				for (size_t y = 0; y<field_dim.y; y++) {
-					for (size_t x = 0; x<field_dim.x; x++, i++) {
-						
-						// get norm'd coordinate:
-						glm::vec3 norm = glm::vec3(x,y,z) / field_dimf;
-						glm::vec2 norm2 = glm::vec2(norm.x, norm.z);
+		fluid_step(fluid_velocities, fluid_gradient, fluid_boundary.front(), bricks, dt);
+		fluid_publish();
 
-						// sample flow field:
-						auto flo = al_field2d_readnorm_interp(land_dim2, flowsmooth, norm2);
+		// once the fastest voxel has been barely moving for a while, go quiet:
+		fluid_calm_ticks = fluid_cfl < fluid_calm_cfl ? fluid_calm_ticks + 1 : 0;
+		if (fluid_calm_ticks >= fluid_calm_ticks_to_sleep) fluid_quiescent = 1;
+	}
 
-						// limit magnitude?
-						float flospd = glm::length(flo);
-						minspeed = glm::min(flospd, minspeed);
-						maxspeed = glm::max(flospd, maxspeed);
-						avgspeed += flospd;
+	// resample the optical flow to one force per column of a fluid grid of size dim, area-averaged,
+	// with the speed threshold & scale applied, into fluid_flow_force
+	// returns the largest force
+	float fluid_resample_flow(const glm::ivec3 dim) {
+		fluid_flow_force.resize(dim.x * dim.z);
+		glm::vec2 * force = &fluid_flow_force[0];
+		const glm::vec2 * flows = fluid_flow.pin(flow_published);
+		if (!flows) {
+			std::fill(fluid_flow_force.begin(), fluid_flow_force.end(), glm::vec2(0.f));
+			return 0.f;
+		}
+		std::vector<float> zmax(dim.z);
+		workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+			field2d_box_downsample_rows(land_dim2, flows, glm::ivec2(dim.x, dim.z), force, z0, z1);
+			const float threshold = glm::max(fluid_flow_min_threshold, 0.f);
+			const float threshold2 = threshold * threshold;
+			for (int z = z0; z<z1; z++) {
+				float peak2 = 0.f;
+				for (size_t i = size_t(z)*dim.x; i < size_t(z+1)*dim.x; i++) {
+					const glm::vec2 flo = force[i];
+					const float flo2 = glm::dot(flo, flo);
+					force[i] = flo2 > threshold2 ? flo * flow_scale : glm::vec2(0.f);
+					peak2 = glm::max(peak2, flo2 > threshold2 ? flo2 : 0.f);
+				}
+				zmax[z] = sqrtf(peak2) * flow_scale;
+			}
+		});
+		float peak = 0.f;
+		for (int z=0; z<dim.z; z++) peak = glm::max(peak, zmax[z]);
+		return peak;
+	}
 
-						flo = flospd > fluid_flow_min_threshold ? flo : glm::vec2(0.f);
+	void fluid_publish() {
+		fluid_published.publish(fluid_velocities.front(), FLUID_VOXELS);
+	}
 
-						// use this to sample the landscape:
-						float sdist;
-						al_field3d_readnorm_interp(sdf_dim, distance, norm, &sdist);
-						float dist = fabsf(sdist);
+	// apply the pushes published since last time to the fluid, and mark their bricks occupied
+	// returns the strongest push
+	float fluid_merge_deposits() {
+		float peak2 = 0.f;
+		for (auto& d : fluid_deposits.take()) {
+			al_field3d_addnorm_interp(fluid_dim, fluid_velocities.front(), d.norm, d.value);
+			fluid_occupy(d.norm);
+			peak2 = glm::max(peak2, glm::dot(d.value, d.value));
+		}
+		return sqrtf(peak2);
+	}
 
-						// TODO: what happens 'underground'?
-						// should velocities here be zeroed? or set to a slight upward motion?	
+	// note a chemical deposit at this norm'd location, so that its tile is processed
+	void chemical_touch(glm::vec2 norm2) {
+		glm::ivec2 cell = glm::min(glm::ivec2(glm::fract(norm2) * glm::vec2(fungus_dim)), fungus_dim - 1);
+		chemical_tile_touched[(cell.y/FIELD_TILE)*FUNGUS_TILES_X + cell.x/FIELD_TILE] = sim_frame.load();
+	}
 
-						// generate a normalized influence factor -- the closer we are to the surface, the greater this is
-						//float influence = glm::smoothstep(0.05f, 0.f, dist);
-						// s is the amount of dist where the influence is 50%
-						float s = fluid_contour_follow;
-						float influence = s / (s + dist);
+	// note that a creature has pushed the fluid at this norm'd location
+	// so that the brick around it stays in the solver's domain
+	// (particles only ride the fluid, and there are so many of them that they would keep nearly every brick active)
+	void fluid_occupy(glm::vec3 norm) {
+		const glm::ivec3 dim = fluid_velocities.dim();
+		glm::ivec3 cell = glm::min(glm::ivec3(glm::fract(norm) * glm::vec3(dim)), dim - 1);
+		fluid_brick_occupied[field3d_brick_index(dim, cell.x, cell.y, cell.z)] = sim_frame.load();
+	}
 
+	// one step of the fluid solver, split into z-slabs over the worker pool
+	// templated on the field types so that it can also be run on other grid sizes (see benchmark_fluid)
+	// only the bricks marked in the brick map are solved (all of them if bricks is null);
+	// the rest only decay
+	template<typename VelocityField, typename GradientField>
+	void fluid_step(VelocityField& velocities, GradientField& gradient, const FluidBoundary * boundary, const uint8_t * bricks, float dt) {
+		const glm::ivec3 dim = velocities.dim();
+		const glm::vec3 field_dimf = glm::vec3(dim);
+		const size_t plane = dim.x * dim.y;
+		const int slabs = field3d_slabs(workers, dim.z);
+		// velocities are in world terms, so a finer axis needs more voxels of displacement per step:
+		const glm::vec3 advection = fluid_advection * field_dimf / float(FLUID_REFERENCE_DIM);
+		// and the projection weighs each axis by its (relative) inverse cell size:
+		const glm::vec3 axis_weight = field_dimf / glm::max(field_dimf.x, glm::max(field_dimf.y, field_dimf.z));
+		// (and the Laplacian of the diffusion passes by its square)
+		const glm::vec3 laplacian_weight = axis_weight * axis_weight;
+
+		// the bricks the solver skips keep their velocities, carried over into each buffer as it is swapped in
+		// (so that the front is always whole, and the solved bricks' halos read current values):
+		auto carry_inactive = [&](const glm::vec3 * src, glm::vec3 * dst) {
+			if (!bricks) return;
+			workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+				field3d_fill_inactive_slab(dim, src, dst, z0, z1, bricks);
+			});
+		};
 
-						glm::vec3& vel = velocities[i];
+		// diffuse the velocities (viscosity)
+		velocities.swap();
+		carry_inactive(velocities.back(), velocities.front());
+		if (diffuse_red_black) {
+			field3d_diffuse_rb(workers, dim, velocities.back(), velocities.front(), glm::vec3(fluid_viscosity), (fluid_passes + 1) / 2, diffuse_sor, bricks, laplacian_weight);
+		} else {
+			field3d_diffuse_slabs(workers, slabs, dim, velocities.back(), velocities.front(), glm::vec3(fluid_viscosity), fluid_passes, bricks, laplacian_weight);
+		}
 
-						vel.x += flo.x * flow_scale;
-						vel.z += flo.y * flow_scale;
-						
-						// get a normal for the land:
-						// TODO: or read from state->land xyz?
-						glm::vec3 normal = sdf_field_normal4(sdf_dim, distance, norm, 1.f/SDF_DIM);
-						// re-orient to be orthogonal to the land normal:
-						glm::vec3 rescaled = make_orthogonal_to(vel, normal);
-						// update:
-						vel = mix(vel, rescaled, influence);	
-
-						// also provide an outer boundary:
-						glm::vec3 central = 0.5f-norm;
-						central.y = 0.f;
-						auto factor = glm::dot(central, central);
-						central = glm::length(vel) * safe_normalize(central);
-						// update:
-						//vel = mix(vel, central, factor);	
+		// the optical flow, resampled by fluid_resample_flow():
+		const glm::vec2 * force = &fluid_flow_force[0];
+
+		// add the flow to the velocity field, and
+		// apply boundary effect to the velocity field
+		// boundary effect is the landscape, forcing the fluid to align to it when near
+		workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+			glm::vec3 * front = velocities.front();
+			for (int z = z0; z<z1; z++) {
+				const glm::vec2 * forcerow = force + size_t(z)*dim.x;
+				for (int y = 0; y<dim.y; y++) {
+					const size_t row = z*plane + y*dim.x;
+					const uint8_t * brickrow = field3d_brick_row(dim, bricks, y, z);
+					for (int x0 = 0; x0<dim.x; x0 += FIELD_BRICK) {
+						if (brickrow && !brickrow[x0/FIELD_BRICK]) continue;
+						const int x1 = glm::min(x0 + FIELD_BRICK, dim.x);
+						for (int x = x0; x<x1; x++) {
+							glm::vec3& vel = front[row + x];
+							vel.x += forcerow[x].x;
+							vel.z += forcerow[x].y;
+						}
+
+						// re-orient to be orthogonal to the land normal, weighted by the baked influence:
+						// TODO: what happens 'underground'? (boundary[i].underground)
+						// should velocities here be zeroed? or set to a slight upward motion?
+						fluid_apply_boundary(front, boundary, row + x0, row + x1);
 					}
 				}
 			}
-			//console.log("flow min speed %f max speed %f avg speed %f", minspeed, maxspeed, avgspeed / FIELD_VOXELS);
-		}
 
+			// also provide an outer boundary?
+			// glm::vec3 central = 0.5f-norm;
+			// central.y = 0.f;
+			// auto factor = glm::dot(central, central);
+			// central = glm::length(vel) * safe_normalize(central);
+			// vel = mix(vel, central, factor);
+		});
 
 		// stabilize:
 		// prepare new gradient data:
-		al_field3d_zero(dim, fluid_gradient.back());
-		al_field3d_derive_gradient(dim, fluid_velocities.back(), fluid_gradient.back()); 
+		// (the skipped bricks carry no pressure)
+		workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+			field3d_fill_inactive_slab(dim, (const float *)0, gradient.back(), z0, z1, bricks);
+			field3d_fill_inactive_slab(dim, (const float *)0, gradient.front(), z0, z1, bricks);
+			field3d_derive_gradient_slab(dim, velocities.back(), gradient.back(), axis_weight, z0, z1, bricks);
+		});
 		// diffuse it:
-		al_field3d_diffuse(dim, fluid_gradient.back(), fluid_gradient.front(), 0.5f, fluid_passes / 2);
+		if (diffuse_red_black) {
+			field3d_diffuse_rb(workers, dim, gradient.back(), gradient.front(), 0.5f, (fluid_passes / 2 + 1) / 2, diffuse_sor, bricks, laplacian_weight);
+		} else {
+			field3d_diffuse_slabs(workers, slabs, dim, gradient.back(), gradient.front(), 0.5f, fluid_passes / 2, bricks, laplacian_weight);
+		}
 		// subtract from current velocities:
-		al_field3d_subtract_gradient(dim, fluid_gradient.front(), fluid_velocities.front());
-		
-		// advect:
-		fluid_velocities.swap(); 
-		al_field3d_advect(dim, fluid_velocities.front(), fluid_velocities.back(), fluid_velocities.front(), fluid_advection);
+		workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+			field3d_subtract_gradient_slab(dim, gradient.front(), velocities.front(), axis_weight, z0, z1, bricks);
+		});
+
+		// CFL: the most voxels any velocity would carry something in one advection step
+		// measured (and clamped) on the projected velocities of the solved bricks, which are what the first substep traces with;
+		// each later substep traces with the result of the one before, which interpolation (and the MacCormack
+		// limiter) keeps within the range of its source, so the clamp bounds every substep
+		std::vector<float> zmax(dim.z);
+		workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+			field3d_max_advection_slab(dim, velocities.front(), advection, z0, z1, &zmax[0], bricks);
+		});
+		float cfl = 0.f;
+		for (int z=0; z<dim.z; z++) cfl = glm::max(cfl, zmax[z]);
+		// split the advection into enough substeps to keep each under fluid_cfl_max, up to a limit:
+		const float cfl_max = glm::max(fluid_cfl_max, 0.01f);
+		const int substeps = glm::clamp(int(ceilf(cfl / cfl_max)), 1, glm::max(fluid_substeps_max, 1));
+		if (cfl > substeps * cfl_max) {
+			// over the limit; rather than spend more time, slow down the fastest voxels:
+			const glm::vec3 limit = (substeps * cfl_max) / advection;
+			workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+				field3d_clamp_slab(dim, velocities.front(), -limit, limit, z0, z1, bricks);
+			});
+		}
+		fluid_cfl = cfl;
+		fluid_substeps = substeps;
 
-		// friction:
-		al_field3d_scale(dim, fluid_velocities.front(), glm::vec3(fluid_decay));
-		
+		// advect:
+		const glm::vec3 substep_advection = advection / float(substeps);
+		for (int n=0; n<substeps; n++) {
+			// friction is applied once, with the last substep:
+			const bool last = n == substeps-1;
+			// the velocities advect themselves, from back into front:
+			velocities.swap();
+			carry_inactive(velocities.back(), velocities.front());
+			if (fluid_advection_mode == 1) {
+				// MacCormack: a forward step into the scratch field, then the corrected result into front
+				// (the reverse trace may read the forward field of a skipped brick, where nothing moved)
+				fluid_advect_scratch.resize(velocities.length());
+				glm::vec3 * forward = &fluid_advect_scratch[0];
+				carry_inactive(velocities.back(), forward);
+				workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+					field3d_advect_slab(dim, velocities.back(), velocities.back(), forward, substep_advection, z0, z1, bricks);
+				});
+				workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+					field3d_advect_maccormack_slab(dim, velocities.back(), velocities.back(), forward, velocities.front(), substep_advection, z0, z1, bricks);
+					if (last) field3d_scale_slab(dim, velocities.front(), glm::vec3(fluid_decay), z0, z1);
+				});
+			} else {
+				workers.parallel_for(0, dim.z, [&](int z0, int z1) {
+					field3d_advect_slab(dim, velocities.back(), velocities.back(), velocities.front(), substep_advection, z0, z1, bricks);
+					// friction (everywhere, so that bricks dropping out of the domain come to rest):
+					if (last) field3d_scale_slab(dim, velocities.front(), glm::vec3(fluid_decay), z0, z1);
+				});
+			}
+		}
 	}
-	void fields_update(float dt) {
-		const glm::ivec2 dim = glm::ivec2(FUNGUS_DIM, FUNGUS_DIM);
-		const glm::vec2 invdim = 1.f/glm::vec2(dim);
 
-		if (1) {
-			// this block is quite expensive, apparently
-			float * const src_array = fungus_field.front(); 
-			float * dst_array = fungus_field.back(); 
-
-
-			for (int i=0, y=0; y<dim.y; y++) {
-				for (int x=0; x<dim.x; x++, i++) {
-					const glm::vec2 cell = glm::vec2(float(x),float(y));
-					const glm::vec2 norm = cell*invdim;
-					float C = src_array[i];
-					float C1 = C - 0.1;
-					//float h = 20 * .1;//heightmap_array.sample(norm);
+	// resample land & human to the fungus resolution, as the height terms the CA needs, and publish them
+	// (run by the land thread whenever either has changed)
+	// humans: the human field (LAND_DIM^2) to derive the human-land term from
+	void generate_fungus_terrain(const float * humans) {
+		const glm::vec2 invdim = 1.f/glm::vec2(fungus_dim);
+		workers.parallel_for(0, FUNGUS_DIM, [&](int y0, int y1) {
+			for (int y=y0; y<y1; y++) {
+				for (int x=0; x<FUNGUS_DIM; x++) {
+					const glm::vec2 norm = glm::vec2(float(x), float(y)) * invdim;
 					glm::vec4 l;
 					al_field2d_readnorm_interp(glm::ivec2(LAND_DIM, LAND_DIM), land, norm, &l);
 					float hm = l.w * field2world_scale - coastline_height;
-					float h = l.w;
-					float hu = al_field2d_readnorm_interp(land_dim2, human.front(), norm);
+					float hu = al_field2d_readnorm_interp(land_dim2, humans, norm);
 					float hum = hu * field2world_scale - coastline_height;
 					float hlm = hum - hm;
-					float dst = C;
-					if (hm <= 0 || hlm > 2.) {
-						// force lowlands to be vacant
-						// (note, human will also do this)
-						dst = 0;
-						
-					} else if (C < 0.) {
-						// very negative values gradually drift back to zero
-						// maybe this "fertility" should also depend on height!!
-						dst = C + dt*fungus_recovery_rate;
-					} else if (hm < 0.) {
-						dst = 0.;
-					} else if (rnd::uni() < hm * fungus_seeding_chance * dt) {
-						// seeding chance
-						dst = rnd::uni();
-					} else if (rnd::uni() < fungus_decay_chance * dt / hm) {
-						// if land lower than vitality, decrease vitality
-						// also random chance of decay for any living cell
-						//dst = C * rnd::uni(); //- dt*fungus_recovery_rate;
-						dst = glm::max(C, rnd::uni());
-					} else if (rnd::uni() < hm * fungus_migration_chance * dt) {
-						// migration chance increases with altitude
-						// pick a neighbour cell:
-						glm::vec2 tc = cell + glm::vec2(floor(rnd::uni()*3)-1, floor(rnd::uni()*3)-1);
-						float tv = al_field2d_read(dim, src_array, tc); //src_array.samplepix(tc);
-						// if alive, copy it
-						if (tv > 0.) { dst = tv; }
+					// force lowlands to be vacant
+					// (note, human will also do this)
+					float lowland = (hm <= 0.f || hlm > 2.f) ? 1.f : 0.f;
+					fungus_terrain[y*FUNGUS_DIM + x] = glm::vec4(hm, hlm, lowland, 0.f);
+				}
+			}
+		});
+		fungus_terrain_published.publish(fungus_terrain, FUNGUS_TEXELS);
+	}
+
+	// mark the tiles in which every cell of terrain is lowland
+	// (run by the field thread at the start of each CA generation, for the terrain that generation uses)
+	void fungus_update_vacancy(const glm::vec4 * terrain) {
+		workers.parallel_for(0, FUNGUS_TILES_X, [&](int row0, int row1) {
+			for (int ty=row0; ty<row1; ty++) {
+				for (int tx=0; tx<FUNGUS_TILES_X; tx++) {
+					float vacant = 1.f;
+					for (int y=ty*FIELD_TILE; y<(ty+1)*FIELD_TILE; y++) {
+						const glm::vec4 * row = terrain + y*FUNGUS_DIM + tx*FIELD_TILE;
+						for (int x=0; x<FIELD_TILE; x++) {
+							vacant = glm::min(vacant, row[x].z);
+						}
 					}
+					fungus_tile_vacant[ty*FUNGUS_TILES_X + tx] = vacant > 0.f;
+				}
+			}
+		});
+	}
+
+	// one tick of the fungus CA over the rows [y0, y1), from fungus_field.front() into fungus_field.back()
+	// terrain is the snapshot of fungus_terrain that the generation uses
+	// every rule is evaluated for every cell, each with its own counter-based random draw,
+	// and the results are combined with selects in order of priority;
+	// since the draws are independent this has the same odds as the original if/else ladder
+	void fungus_update_rows(float dt, uint32_t seed, const glm::vec4 * terrain_array, int y0, int y1) {
+		const glm::ivec2 dim = fungus_dim;
+		const float * src_array = fungus_field.front();
+		float * dst_array = fungus_field.back();
+		const float seeding = fungus_seeding_chance * dt;
+		const float decaying = fungus_decay_chance * dt;
+		const float migrating = fungus_migration_chance * dt;
+		const float recovery = fungus_recovery_rate * dt;
+		for (int y=y0; y<y1; y++) {
+			const int ym = y ? y-1 : dim.y-1, yp = y+1 < dim.y ? y+1 : 0;
+			const int tilerow = (y/FIELD_TILE)*FUNGUS_TILES_X;
+			for (int x0=0; x0<dim.x; x0+=FIELD_TILE) {
+				// skip tiles that are vacant & already zero in both buffers:
+				const int t = tilerow + x0/FIELD_TILE;
+				if (fungus_tile_cleared[t] >= 2 && fungus_tile_vacant[t]) continue;
+				for (int x=x0; x<x0+FIELD_TILE; x++) {
+					const int i = y*dim.x + x;
+					const float C = src_array[i];
+					const glm::vec4 terrain = terrain_array[i];
+					const float hm = terrain.x;
+					const uint32_t key = hash32(seed ^ uint32_t(i));
+
+					// migration chance increases with altitude
+					// pick one of the 3x3 block of cells (including this one); if alive, copy it
+					const int n = int(hash_uni(key, 0) * 9.f);
+					const int nx = x + n%3 - 1, dy = n/3 - 1;
+					const float tv = src_array[(dy < 0 ? ym : dy > 0 ? yp : y)*dim.x + (nx < 0 ? dim.x-1 : nx >= dim.x ? 0 : nx)];
+					const bool migrate = hash_uni(key, 1) < hm * migrating && tv > 0.f;
+					// if land lower than vitality, decrease vitality
+					// also random chance of decay for any living cell
+					// (r < decaying/hm, without the divide; hm <= 0 is vacant anyway)
+					const bool decay = hash_uni(key, 2) * hm < decaying;
+					// seeding chance
+					const bool seed_here = hash_uni(key, 3) < hm * seeding;
+
+					float dst = C;
+					dst = migrate ? tv : dst;
+					dst = decay ? glm::max(C, hash_uni(key, 4)) : dst;
+					dst = seed_here ? hash_uni(key, 5) : dst;
+					// very negative values gradually drift back to zero
+					// maybe this "fertility" should also depend on height!!
+					dst = C < 0.f ? C + recovery : dst;
+					// force lowlands to be vacant
+					dst = terrain.z > 0.f ? 0.f : dst;
 					dst_array[i] = glm::clamp(dst, -1.f, 1.f);
 				}
 			}
-			fungus_field.swap();
 		}
+	}
 
-		if (1) {
-			// diffuse & decay the chemical fields:
-			// copy front to back, then diffuse
-			// TODO: is this any different to just diffuse (front, front) ? if not, we could eliminate this copy
-			// (or, would .swap() rather than .copy() work for us?)
-			chemical_field.swap();	
-			al_field2d_diffuse(fungus_dim, chemical_field.back(), chemical_field.front(), chemical_diffuse, 2);
-			size_t elems = chemical_field.length();
-			for (size_t i=0; i<elems; i++) {
-				// the current simulated field values:
-				glm::vec3& chem = chemical_field.front()[i];
-				float f = fungus_field.front()[i];
-				// the current smoothed fields as used by the renderer:
-				glm::vec4& tex = field_texture[i];
-				// the current smoothed fungus value:
-				float f0 = tex.w; 
-
-				// fungus increases smoothly, but death is immediate:
-				float f1 = (f <= 0) ? f : glm::mix(f0, f, 0.1f);
-
-				// other fields just clamp & decay:
-				chem = glm::clamp(chem * chemical_decay, 0.f, 1.f);
-
-				// now copy these modified results back to the field_texture:
-				tex = glm::vec4(chem, f1);
+	// one fused pass of the chemical fields over the tile rows [ty0, ty1):
+	// for each active tile, diffuse from chemical_field.front(), decay & clamp into chemical_field.back(),
+	// and pack the result with the smoothed fungus into field_texture; tiles never write outside themselves
+	// (diffusion is zero when front has already been blurred)
+	void chemical_update_tiles(int ty0, int ty1, const glm::vec3 diffusion) {
+		const glm::vec3 * src = chemical_field.front();
+		glm::vec3 * dst = chemical_field.back();
+		glm::vec3 chems[FIELD_TILE*FIELD_TILE];
+		for (int ty=ty0; ty<ty1; ty++) {
+			for (int tx=0; tx<FUNGUS_TILES_X; tx++) {
+				const int t = ty*FUNGUS_TILES_X + tx;
+				const int x0 = tx*FIELD_TILE, y0 = ty*FIELD_TILE;
+				// the fungus front is zero here:
+				const bool fungus_zero = fungus_tile_cleared[t] >= 1;
+				const bool chem_active = chemical_tile_active[t];
+				// nothing to do for tiles that are provably zero:
+				if (!chem_active && fungus_zero && texture_tile_zero[t]) continue;
+
+				bool live = false;
+				if (chem_active) {
+					field2d_diffuse_tile2(fungus_dim, src, x0, y0, diffusion, chems);
+					// other fields just clamp & decay:
+					float peak = 0.f;
+					for (int i=0; i<FIELD_TILE*FIELD_TILE; i++) {
+						glm::vec3& chem = chems[i];
+						chem = glm::clamp(chem * chemical_decay, 0.f, 1.f);
+						peak = glm::max(peak, glm::max(chem.x, glm::max(chem.y, chem.z)));
+					}
+					live = peak >= chemical_zero_threshold;
+					// once dead, zero it, so that the tile can be skipped from now on:
+					if (!live) {
+						for (int i=0; i<FIELD_TILE*FIELD_TILE; i++) chems[i] = glm::vec3(0.f);
+					}
+					chemical_tile_live[t] = live;
+				} else {
+					// idle; both buffers are zero here
+					for (int i=0; i<FIELD_TILE*FIELD_TILE; i++) chems[i] = glm::vec3(0.f);
+				}
+
+				for (int y=0; y<FIELD_TILE; y++) {
+					const size_t row = (y0 + y)*FUNGUS_DIM + x0;
+					for (int x=0; x<FIELD_TILE; x++) {
+						const glm::vec3& chem = chems[y*FIELD_TILE + x];
+						if (chem_active) dst[row + x] = chem;
+						float f = fungus_field.front()[row + x];
+						// the current smoothed fields as used by the renderer:
+						glm::vec4& tex = field_texture[row + x];
+						// the current smoothed fungus value:
+						float f0 = tex.w; 
+
+						// fungus increases smoothly, but death is immediate:
+						float f1 = (f <= 0) ? f : glm::mix(f0, f, 0.1f);
+
+						// now copy these modified results back to the field_texture:
+						tex = glm::vec4(chem, f1);
+					}
+				}
+				texture_tile_zero[t] = !live && fungus_zero;
 			}
 		}
-			
-		if (1) {
-			// diffuse and decay the emission field:
-			al_field3d_scale(field_dim, emission_field.back(), glm::vec3(emission_decay));
-			al_field3d_diffuse(field_dim, emission_field.back(), emission_field.front(), emission_diffuse);
-			emission_field.swap();
+	}
+
+	void fields_update(float dt) {
+		fungus_stage(dt);
+		chemical_stage(dt);
+		emission_stage(dt);
+	}
+
+	// the fungus CA: one generation every 1/fungus_rate seconds, with its probabilities scaled by that time,
+	// spread over as many field ticks as it takes to stay within fungus_budget_ms per tick
+	void fungus_stage(float dt) {
+		// the time passing during a generation's slices counts towards the next one:
+		fungus_clock.advance(dt);
+		if (fungus_slice == 0) {
+			if (!fungus_clock.is_due(dt, fungus_rate)) return;
+			// start a new generation, with the latest terrain held until it is complete
+			// (so that every row, and the vacancy that the tiles are cleared by, see the same terrain):
+			if (!fungus_generation_terrain.pin(fungus_terrain_published)) return;
+			fungus_generation_begin(fungus_generation_terrain.data(), fungus_clock.begin(), hash32(++fungus_tick));
+			// boids eat fungus:
+			// (a tile they eat into is no longer provably zero, so it has to be processed again)
+			for (auto& d : fungus_deposits.take()) {
+				const int i = al_field2d_index_norm(fungus_dim, d.norm);
+				fungus_field.front()[i] -= d.value;
+				fungus_tile_cleared[((i / FUNGUS_DIM)/FIELD_TILE)*FUNGUS_TILES_X + (i % FUNGUS_DIM)/FIELD_TILE] = 0;
+			}
+		}
+
+		Timer timer;
+		timer.measure();
+		// this block is quite expensive, apparently
+		// so it runs a slice of fungus_slice_rows tile rows per tick
+		const int ty0 = fungus_slice;
+		const int ty1 = glm::min(ty0 + glm::clamp(fungus_slice_rows, 1, FUNGUS_TILES_X), FUNGUS_TILES_X);
+		fungus_generation_rows(fungus_generation_terrain.data(), ty0, ty1);
+		fungus_slice = ty1 < FUNGUS_TILES_X ? ty1 : 0;
+
+		if (fungus_slice == 0) {
+			// the generation is complete:
+			fungus_generation_end();
+			fungus_published.publish(fungus_field.front(), FUNGUS_TEXELS);
+		}
+
+		// fewer rows next time if this slice was over budget, more if well under:
+		const float ms = float(timer.measure() * 1000.);
+		if (fungus_clock.end(ms, fungus_budget_ms)) {
+			fungus_slice_rows = glm::max(fungus_slice_rows - 1, 1);
+		} else if (ms < fungus_budget_ms * 0.5f) {
+			fungus_slice_rows = glm::min(fungus_slice_rows + 1, FUNGUS_TILES_X);
 		}
 	}
-	
-	void sim_update(float dt, AudioState * audiostate) {
 
-		// inverse dt gives rate (per second)
-		float idt = 1.f/dt;
+	// the parts of a fungus generation, on this State's fields alone (see fungus_stage, and benchmark_fields):
+	// start one on terrain (a snapshot of fungus_terrain), lasting dt, with its random seed
+	void fungus_generation_begin(const glm::vec4 * terrain, float dt, uint32_t seed) {
+		fungus_update_vacancy(terrain);
+		fungus_generation_dt = dt;
+		fungus_generation_seed = seed;
+	}
 
-		Alice& alice = Alice::Instance();
+	// the tile rows [ty0, ty1) of the generation, one tile row per task
+	// (rows only write back, and migration reads its neighbours from front, so bands never see each other's results,
+	// even when they run in different ticks)
+	void fungus_generation_rows(const glm::vec4 * terrain, int ty0, int ty1) {
+		workers.parallel_for(ty0, ty1, [&](int row0, int row1) {
+			fungus_update_rows(fungus_generation_dt, fungus_generation_seed, terrain, row0*FIELD_TILE, row1*FIELD_TILE);
+		}, ty1 - ty0);
+	}
 
+	// once every row is done
+	void fungus_generation_end() {
+		fungus_field.swap();
+		int active = 0;
+		for (int t=0; t<FUNGUS_TILES; t++) {
+			active += !(fungus_tile_cleared[t] >= 2 && fungus_tile_vacant[t]);
+			fungus_tile_cleared[t] = fungus_tile_vacant[t] ? glm::min(fungus_tile_cleared[t] + 1, 2) : 0;
+		}
+		fungus_active_tiles = active;
+	}
 
-		// get the most recent complete frame:
-		flip = !flip;
-		const CloudDevice& cd = alice.cloudDeviceManager.devices[0];
-		const CloudFrame& cloudFrame = cd.cloudFrame();
-		const glm::vec3 * cloud_points = cloudFrame.xyz;
-		const glm::vec2 * uv_points = cloudFrame.uv;
-		const glm::vec3 * rgb_points = cloudFrame.rgb;
-		uint64_t max_cloud_points = sizeof(cloudFrame.xyz)/sizeof(glm::vec3);
-		glm::vec2 kaspectnorm = 1.f/glm::vec2(float(cColorHeight)/float(cColorWidth), 1.f);
-		glm::vec3 kinectloc = world_centre + glm::vec3(0,0,-4);
+	void chemical_stage(float dt) {
+		if (!chemical_clock.due_at(dt, chemical_rate)) return;
+		chemical_clock.begin();
+		Timer timer;
+		timer.measure();
+
+		// diffuse & decay the chemical fields, and pack the render texture:
+		// (only where there are chemicals, or deposits since last time, and around them)
+		for (auto& d : chemical_deposits.take()) {
+			al_field2d_addnorm_interp(fungus_dim, chemical_field.front(), d.norm, d.value);
+			chemical_touch(d.norm);
+		}
+		chemical_step();
+		chemical_published.publish(chemical_field.front(), FUNGUS_TEXELS);
+		field_texture_published.publish(field_texture, FUNGUS_TEXELS);
 
-		// deal with Kinect data:
-		CloudDevice& kinect0 = alice.cloudDeviceManager.devices[0];
-		CloudDevice& kinect1 = alice.cloudDeviceManager.devices[1];
+		chemical_clock.end(float(timer.measure() * 1000.), chemical_budget_ms);
+	}
 
-		// map depth data onto land:
-		if (1) {
-			// first, dampen the human field:
-			for (int i=0; i<LAND_TEXELS; i++) {
-				human.front()[i] *= human_height_decay;
+	// one step of the chemical fields, on this State's fields alone
+	void chemical_step() {
+		// one implicit diffusion step spreads by sigma = sqrt(2 * diffusion) cells
+		// once that is wide enough, a recursive Gaussian blur of the whole field does it at a fixed cost,
+		// however wide; it reaches every tile though, so then they all have to be visited
+		const glm::vec3 sigma = glm::sqrt(2.f * chemical_diffuse);
+		const bool blur = glm::min(sigma.x, glm::min(sigma.y, sigma.z)) >= RECURSIVE_GAUSSIAN_MIN_SIGMA;
+		uint8_t seed[FUNGUS_TILES];
+		int active = 0;
+		const uint32_t frame = sim_frame.load();
+		for (int t=0; t<FUNGUS_TILES; t++) {
+			seed[t] = blur || chemical_tile_live[t] || int(frame - chemical_tile_touched[t]) <= chemical_touch_frames;
+		}
+		field2d_dilate_tiles(fungus_tile_dim, seed, chemical_tile_active);
+		for (int t=0; t<FUNGUS_TILES; t++) active += chemical_tile_active[t];
+		chemical_active_tiles = active;
+		if (blur) field2d_blur_recursive(workers, fungus_dim, chemical_field.front(), sigma);
+
+		// front to back, tile by tile (one tile row per task), then swap
+		const glm::vec3 diffusion = blur ? glm::vec3(0.f) : chemical_diffuse;
+		workers.parallel_for(0, FUNGUS_TILES_X, [&](int row0, int row1) {
+			chemical_update_tiles(row0, row1, diffusion);
+		}, FUNGUS_TILES_X);
+		// tiles that died were zeroed in back; zero them in front too, so both buffers stay zero while idle
+		// (after the whole pass, since neighbouring tiles read front as their halo)
+		for (int t=0; t<FUNGUS_TILES; t++) {
+			if (!chemical_tile_active[t] || chemical_tile_live[t]) continue;
+			const int x0 = (t % FUNGUS_TILES_X)*FIELD_TILE, y0 = (t / FUNGUS_TILES_X)*FIELD_TILE;
+			for (int y=y0; y<y0+FIELD_TILE; y++) {
+				glm::vec3 * row = chemical_field.front() + y*FUNGUS_DIM + x0;
+				for (int x=0; x<FIELD_TILE; x++) row[x] = glm::vec3(0.f);
 			}
-			
-			// for each Kinect
-			for (int k=0; k<2; k++) {
-				//if (k == 11) continue;
+		}
+		chemical_field.swap();
+	}
 
-				
-				const CloudFrame& cloudFrame0 = k ? kinect1.cloudFrame() : kinect0.cloudFrame();
-				const CloudFrame& cloudFrame1 = k ? kinect1.cloudFramePrev() : kinect0.cloudFramePrev();
-				const glm::vec3 * cloud_points0 = cloudFrame0.xyz;
-				const glm::vec2 * uv_points0 = cloudFrame0.uv;
-				const glm::vec3 * rgb_points0 = cloudFrame0.rgb;
-				const uint16_t * depth0 = cloudFrame0.depth;
-
-				// now update with live data:
-				for (int i=0, y=0; y < cDepthHeight; y++) {
-					for (int x=0; x < cDepthWidth; x++, i++) {
-
-						// masks:
-						if (k==1 && (x > cDepthWidth * 0.7 && y > cDepthWidth * 0.5)) continue;
-						if (k==1 && (x > cDepthWidth * 0.85)) continue;
-						if (k==0 && (y < cDepthHeight * 0.3 && x > cDepthWidth * 0.75)) continue;
-
-						auto uv = (uv_points0[i] - glm::vec2(0.5f, 0.5f)) * kaspectnorm;
-						if (k==0 && glm::length((uv_points0[i] - glm::vec2(0.17f, 0.93f))* kaspectnorm) < 0.2f) continue;
-
-						if (k==0 && glm::length((uv_points0[i] - glm::vec2(0.57f, 0.8f))* kaspectnorm) < 0.15f) continue;	
-
-						if (k==0 && glm::length((uv_points0[i] - glm::vec2(0.9f, 0.93f))* kaspectnorm) < 0.35f) continue;
-
-						auto pt = cloud_points0[i];
-						// filter out bad depths
-						// mask outside a circular range
-						// skip OOB locations:
-						uint16_t min_dist = 3000;
-						uint16_t max_dist = 6000;
-						if (
-							depth0[i] <= min_dist 
-							|| depth0[i] >= max_dist
-							|| pt.x < world_min.x
-							|| pt.z < world_min.z
-							|| pt.x > world_max.x
-							|| pt.z > world_max.z
-							|| pt.y > (2.0 * kinect2world_scale)
-							) continue;
-
-						// find nearest land cell for this point:
-						// get norm'd coordinate:
-						glm::vec3 norm = transform(world2field, pt);
-						glm::vec2 norm2 = glm::vec2(norm.x, norm.z);
-						// get cell index for this location:
-						int landidx = al_field2d_index_norm(land_dim2, norm2);
-						
-						// set the land value accordingly:
-						float& humanpt0 = human.front()[landidx];
-						float& humanpt1 = human.back()[landidx];
+	void emission_stage(float dt) {
+		if (!emission_clock.due_at(dt, emission_rate)) return;
+		emission_clock.begin();
+		Timer timer;
+		timer.measure();
 
-						float h = world2field_scale * pt.y;
-						humanpt1 = glm::mix(humanpt0, h, 0.4f);
+		// diffuse and decay the emission field:
+		// (front always holds the latest, and is where creatures' deposits are merged)
+		for (auto& d : emission_deposits.take()) {
+			al_field3d_addnorm_interp(field_dim, emission_field.front(), d.norm, d.value);
+		}
+		emission_step();
+		emission_published.publish(emission_field.front(), FIELD_VOXELS);
 
-						// in archi15 we also did spatial filtering
+		emission_clock.end(float(timer.measure() * 1000.), emission_budget_ms);
+	}
 
-					}
-				}
-			} // end 2 kinects
-			
-			//al_field2d_diffuse(land_dim2, human.back(), human.front(), 0.5f, 3);
-			human.swap();
-			// NOW FLOW
-	#ifdef AL_WIN
-			if (1) {
+	// one step of the emission field, on this State's fields alone
+	void emission_step() {
+		const glm::vec3 sigma = glm::sqrt(2.f * emission_diffuse);
+		if (glm::min(sigma.x, glm::min(sigma.y, sigma.z)) >= RECURSIVE_GAUSSIAN_MIN_SIGMA) {
+			// wide enough for the recursive blur (see chemical_stage), also in place
+			glm::vec3 * emission = emission_field.front();
+			workers.parallel_for(0, field_dim.z, [&](int z0, int z1) {
+				field3d_scale_slab(field_dim, emission, glm::vec3(emission_decay), z0, z1);
+			});
+			field3d_blur_recursive(workers, field_dim, emission, sigma);
+		} else if (diffuse_red_black) {
+			// in place: one sweep is one step of implicit diffusion, no back buffer needed
+			glm::vec3 * emission = emission_field.front();
+			workers.parallel_for(0, field_dim.z, [&](int z0, int z1) {
+				field3d_scale_slab(field_dim, emission, glm::vec3(emission_decay), z0, z1);
+			});
+			field3d_diffuse_rb(workers, field_dim, (const glm::vec3 *)0, emission, emission_diffuse, 1);
+		} else {
+			emission_field.swap();
+			glm::vec3 * emission = emission_field.back();
+			workers.parallel_for(0, field_dim.z, [&](int z0, int z1) {
+				field3d_scale_slab(field_dim, emission, glm::vec3(emission_decay), z0, z1);
+			});
+			// 14 passes, as al_field3d_diffuse does by default
+			field3d_diffuse_slabs(workers, field3d_slabs(workers, field_dim.z), field_dim, emission_field.back(), emission_field.front(), emission_diffuse, 14);
+		}
+	}
 
-				// copy human to char arrays for CV:
-				for (int i=0; i<LAND_TEXELS; i++) {
-					humanchar0[i] = humanchar1[i];
-					humanchar1[i] = human.front()[i] * 255;
-				}
-				
-				int levels = 3; // default=5;
-				double pyr_scale = 0.5;
-				int winsize = 13;
-				int iterations = 3; // default = 10;
-				int poly_n = 5;
-				double poly_sigma = 1.2; // default = 1.1
-				int flags = 0;
-				
-				// create CV mat wrapper around Jitter matrix data
-				// (cv declares dim as numrows, numcols, i.e. dim1, dim0, or, height, width)
-				void * src;
-				cv::Mat prev(LAND_DIM, LAND_DIM, CV_8UC(1), (void *)humanchar0);
-				cv::Mat next(LAND_DIM, LAND_DIM, CV_8UC(1), (void *)humanchar1);
-				cv::Mat flow(LAND_DIM, LAND_DIM, CV_32FC(2), (void *)state->flow);
-				cv::calcOpticalFlowFarneback(prev, next, flow, pyr_scale, levels, winsize, iterations, poly_n, poly_sigma, flags);
+	void fields_publish() {
+		chemical_published.publish(chemical_field.front(), FUNGUS_TEXELS);
+		fungus_published.publish(fungus_field.front(), FUNGUS_TEXELS);
+		emission_published.publish(emission_field.front(), FIELD_VOXELS);
+		field_texture_published.publish(field_texture, FUNGUS_TEXELS);
+	}
+	
+	void sim_update(float dt, AudioState * audiostate) {
 
-				for (int i=0; i<LAND_TEXELS; i++) {
-					flowsmooth[i] += flow_smoothing * (state->flow[i] - flowsmooth[i]);
-				}
-				
-			}
-	#endif
+		Alice& alice = Alice::Instance();
 
-			
-		}
-		if (!alice.isSimulating) return;
 
-		if (1) {
-			{
-				const CloudFrame& cloudFrame1 = kinect1.cloudFrame();
-				const glm::vec3 * cloud_points1 = cloudFrame1.xyz;
-				const glm::vec2 * uv_points1 = cloudFrame1.uv;
-				const glm::vec3 * rgb_points1 = cloudFrame1.rgb;
-				const uint16_t * depth1 = cloudFrame1.depth;
-
-				const CloudFrame& cloudFrame0 = kinect0.cloudFrame();
-				const glm::vec3 * cloud_points0 = cloudFrame0.xyz;
-				const glm::vec2 * uv_points0 = cloudFrame0.uv;
-				const glm::vec3 * rgb_points0 = cloudFrame0.rgb;
-				const uint16_t * depth0 = cloudFrame0.depth;
+		sim_frame++;
 
+		// the latest published fields, held until the next tick:
+		sim_chemicals.pin(chemical_published);
+		sim_fungus.pin(fungus_published);
+		sim_fluid.pin(fluid_published);
 
-				int drawn = 0;
-				
-				for (int i=0, ki=0; i<NUM_DEBUGDOTS; i++) {
-					DebugDot& o = debugdots[i];
-					
-					if (kinect0.capturing && i < max_cloud_points) {
-						auto uv = (uv_points0[ki] - 0.5f) * kaspectnorm;
-						if (depth0[ki] > 0 && glm::length(uv) < 0.5f) {
-							o.location = cloud_points0[ki];
-							o.color = glm::vec3(0.8, 0.5, 0.3);
-							drawn++;
-						}
-						ki = (ki+1) % max_cloud_points;
-					} else if (kinect1.capturing && i >= max_cloud_points) {
-						auto uv = (uv_points1[ki] - 0.5f) * kaspectnorm;
-						if (depth1[ki] > 0 && glm::length(uv) < 0.5f) {
-							o.location = cloud_points1[ki];
-							o.color = glm::vec3(0.5, 0.8, 0.3);
-							drawn++;
-						}
-						ki = (ki+1) % max_cloud_points;
-					}
-				}
-				//console.log("%d %d / %d", cDepthHeight*cDepthWidth, max_cloud_points, drawn);
+		// alternate which Kinect's colour image the renderer shows:
+		flip = !flip;
 
+		if (!alice.isSimulating) return;
 
+		// show each Kinect's points (within the middle of its colour view) as a block of DEPTH_PIXELS debug dots:
+		if (1) {
+			const glm::vec2 kaspectnorm = 1.f/glm::vec2(float(cColorHeight)/float(cColorWidth), 1.f);
+			static const glm::vec3 debugdot_colors[] = {
+				glm::vec3(0.8, 0.5, 0.3),
+				glm::vec3(0.5, 0.8, 0.3),
+				glm::vec3(0.3, 0.5, 0.8),
+				glm::vec3(0.8, 0.3, 0.5),
+			};
+			int drawn = 0;
+			for (int k=0; k<DEPTH_DEVICES; k++) {
+				const CloudDevice& kinect = alice.cloudDeviceManager.devices[k];
+				if (!kinect.capturing) continue;
+				const CloudFrame& frame = kinect.cloudFrame();
+				const glm::vec3 color = debugdot_colors[k % 4];
+				DebugDot * dots = debugdots + k*DEPTH_PIXELS;
+				for (int i=0; i<DEPTH_PIXELS; i++) {
+					auto uv = (frame.uv[i] - 0.5f) * kaspectnorm;
+					if (frame.depth[i] > 0 && glm::length(uv) < 0.5f) {
+						dots[i].location = frame.xyz[i];
+						dots[i].color = color;
+						drawn++;
+					}
+				}
 			}
+			//console.log("%d / %d", drawn, NUM_DEBUGDOTS);
 		}
 
 
@@ -988,12 +1581,12 @@ struct State {
 
 				//glm::vec3 flow;
 				//fluid.velocities.front().readnorm(transform(world2field, o.location), &flow.x);
-				glm::vec3 flow = al_field3d_readnorm_interp(field_dim, fluid_velocities.front(), norm);
+				glm::vec3 flow = al_field3d_readnorm_interp(fluid_dim, sim_fluid.data(), norm);
 
 				// noise:
 				flow += glm::sphericalRand(particle_noise);
 
-				o.velocity = flow * idt;
+				o.velocity = flow * fluid_world_speed;
 
 				// chance of becoming egg?
 				float hdist = fabsf(o.location.y - h);
@@ -1062,14 +1655,289 @@ struct State {
 				audioframe.state = 0;
 			}
 		}
+
+		// hand this tick's deposits over to the threads that own those fields:
+		chemical_deposits.publish(sim_chemical_deposits);
+		emission_deposits.publish(sim_emission_deposits);
+		fluid_deposits.publish(sim_fluid_deposits);
+		fungus_deposits.publish(sim_fungus_deposits);
+	}
+
+	// the depth filter stage (on depthFilterThread), between the Kinects and the ingestion stage
+	// whenever a device has delivered a new frame, it goes into the device's history,
+	// and the history's temporal median (with the remaining holes filled) is published for ingestion
+	void depth_filter(float dt) {
+		Alice& alice = Alice::Instance();
+		int frames = 0;
+		for (int k=0; k<DEPTH_DEVICES; k++) {
+			const CloudDevice& device = alice.cloudDeviceManager.devices[k];
+			const CloudFrame * frame = &device.cloudFrame();
+			if (!device.capturing || frame == depth_last_frame[k]) continue;
+			depth_last_frame[k] = frame;
+			frames++;
+
+			if (depth_filter_mode == 0) {
+				depth_published[k].publish(frame->depth, DEPTH_PIXELS);
+				continue;
+			}
+			DepthHistory& history = depth_history[k];
+			if (history.frames.empty()) history.resize();
+			if (depth_filtered.empty()) depth_filtered.resize(DEPTH_PIXELS);
+			history.push(frame->depth);
+			uint16_t * filtered = &depth_filtered[0];
+			// (a pixel can't have more readings than there are frames, and needs at least one)
+			const int min_valid = glm::clamp(depth_filter_min_valid, 1, DEPTH_HISTORY);
+			workers.parallel_for(0, DEPTH_HEIGHT, [&](int y0, int y1) {
+				history.median_rows(y0, y1, min_valid, filtered);
+				if (depth_hole_radius > 0) depth_fill_holes_rows(filtered, y0, y1, depth_hole_radius);
+			});
+			depth_published[k].publish(filtered, DEPTH_PIXELS);
+		}
+		if (!frames) {
+			depth_idle_polls++;
+			return;
+		}
+		depth_frames += frames;
 	}
 
+	// the depth ingestion stage (on ingestThread), polling the depth filter stage
+	// it splats each device's filtered frames that it hasn't seen yet,
+	// and every 1/human_update_rate fuses the devices' latest splats into the human field
+	// (whether or not any are new, so that the field fades out when the cameras stop)
+	void depth_ingest(float dt) {
+		Alice& alice = Alice::Instance();
+		for (int k=0; k<DEPTH_DEVICES; k++) depth_splat_age[k] += dt;
+
+		// take any masks that have been (re)loaded since the last tick:
+		for (int k=0; k<DEPTH_DEVICES; k++) {
+			if (!depth_mask_pending[k]) continue;
+			depth_masks[k] = depth_masks_loaded[k];
+			depth_mask_pending[k] = 0;
+		}
+
+		bool fresh[DEPTH_DEVICES];
+		int frames = 0;
+		for (int k=0; k<DEPTH_DEVICES; k++) {
+			fresh[k] = depth_ingest_frames[k].pin(depth_published[k]) && depth_ingest_frames[k].epoch() != depth_ingested_epoch[k];
+			if (fresh[k]) depth_ingested_epoch[k] = depth_ingest_frames[k].epoch();
+			frames += fresh[k];
+		}
+		if (depth_splat_total.sum.empty()) {
+			for (int b=0; b<DEPTH_BANDS; b++) depth_splats[b].resize(LAND_TEXELS);
+			for (int k=0; k<DEPTH_DEVICES; k++) {
+				depth_device_splats[k].resize(LAND_TEXELS);
+				depth_rays[k].resize();
+			}
+			depth_splat_total.resize(LAND_TEXELS);
+		}
+
+		// map depth data onto land:
+		if (frames) {
+			// the part of the field that depth points may land in, and the highest they may be:
+			// (world2field is a uniform scale, so a point's field y is its height in field units)
+			const glm::vec3 field_min = transform(world2field, world_min);
+			const glm::vec3 field_max = transform(world2field, world_max);
+			const float field_top = 2.f * kinect2world_scale * world2field_scale;
+
+			// for each Kinect with a new frame
+			for (int k=0; k<DEPTH_DEVICES; k++) {
+				if (!fresh[k]) continue;
+				// this frame replaces the device's last one:
+				DepthSplat& device_splat = depth_device_splats[k];
+				device_splat.clear();
+				depth_splat_age[k] = 0.f;
+				const CloudDevice& device = alice.cloudDeviceManager.devices[k];
+				// the filtered depths, and the device's latest point cloud (to learn new pixels' rays from):
+				const uint16_t * depth0 = depth_ingest_frames[k].data();
+				const CloudFrame& cloudFrame0 = device.cloudFrame();
+				const glm::vec3 * cloud_points0 = cloudFrame0.xyz;
+				const uint16_t * raw0 = cloudFrame0.depth;
+
+				// each band of depth rows splats the heights of the pixels that aren't masked out into its own grid,
+				// weighted by the device's weight, and by a confidence that falls off with distance
+				// (the Kinect's depth noise grows with it, as does the area each pixel covers on the sand)
+				const DepthMask& mask = depth_masks[k];
+				const float weight = depth_device_weight[k];
+				if (weight <= 0.f) continue;
+
+				// the pixels' rays, learned again whenever the device has been re-calibrated,
+				// and re-placed in field space whenever it or the field has moved:
+				DepthRays& rays = depth_rays[k];
+				const glm::mat4 camera2world = device.cloudTransform;
+				if (rays.camera2world != camera2world) rays.recalibrate(camera2world, 2);
+				const bool learning = rays.learn_holdoff == 0;
+				if (!learning) rays.learn_holdoff--;
+				const glm::mat4 camera2field = world2field * camera2world;
+				const glm::mat4 world2camera = glm::inverse(camera2world);
+				if (rays.camera2field != camera2field) {
+					rays.camera2field = camera2field;
+					rays.origin = glm::vec3(camera2field[3]);
+					workers.parallel_for(0, DEPTH_HEIGHT, [&](int y0, int y1) {
+						rays.place_rows(y0, y1);
+					});
+				}
+
+				workers.parallel_for(0, DEPTH_BANDS, [&](int b0, int b1) {
+					for (int b=b0; b<b1; b++) {
+						DepthSplat& splat = depth_splats[b];
+						int y0, y1;
+						depth_band_rows(b, y0, y1);
+						depth_mask_foreach(mask, y0, y1, [&](int i) {
+							// filter out bad depths
+							const uint16_t depth = depth0[i];
+							const uint16_t min_dist = 3000;
+							const uint16_t max_dist = 6000;
+							if (depth <= min_dist || depth >= max_dist) return;
+
+							// the first time this pixel has a raw depth, learn its ray from the point cloud
+							// (after which the point cloud is no longer read for it)
+							// the rows of a band are whole words of the mask, so bands never share a word of learned bits
+							if (!rays.learned.get(i)) {
+								if (!learning || !raw0[i]) return;
+								rays.learn(i, transform(world2camera, cloud_points0[i]), raw0[i]);
+							}
+							// norm'd coordinate of the point:
+							const glm::vec3 norm = rays.point(i, depth);
+
+							// skip OOB locations:
+							if (
+								norm.x < field_min.x
+								|| norm.z < field_min.z
+								|| norm.x > field_max.x
+								|| norm.z > field_max.z
+								|| norm.y > field_top
+								) return;
+
+							// find nearest land cell for this point:
+							int landidx = al_field2d_index_norm(land_dim2, glm::vec2(norm.x, norm.z));
+							float closeness = float(min_dist) / float(depth);
+							float w = weight * closeness * closeness;
+							splat.add(landidx, w * norm.y, w);
+						});
+					}
+				}, DEPTH_BANDS);
+
+				// merge the bands, always in the same order:
+				for (int b=0; b<DEPTH_BANDS; b++) depth_splats[b].merge_into(device_splat);
+			} // end kinects
+		}
+
+		// fuse the devices' latest splats, so that where their views overlap each cell gets the mean of all their points:
+		if (!human_clock.due_at(dt, human_update_rate)) return;
+		const float elapsed = human_clock.begin();
+		{
+			for (int k=0; k<DEPTH_DEVICES; k++) {
+				if (depth_splat_age[k] <= depth_splat_max_age) depth_device_splats[k].add_to(depth_splat_total);
+			}
+
+			// dampen the human field (by however much time has passed since it was last updated),
+			// and blend in the weighted mean height of the points that fell in each cell:
+			const float decay = powf(human_height_decay, elapsed * 25.f);
+			const float blend = 1.f - powf(1.f - glm::clamp(human_height_blend, 0.f, 1.f), elapsed * 30.f);
+			const float * human0 = human.front();
+			float * human1 = human.back();
+			workers.parallel_for(0, LAND_TEXELS, [&](int i0, int i1) {
+				for (int i=i0; i<i1; i++) human1[i] = human0[i] * decay;
+			});
+			for (int cell : depth_splat_total.touched) {
+				human1[cell] = glm::mix(human1[cell], depth_splat_total.mean(cell), blend);
+				// in archi15 we also did spatial filtering
+			}
+			depth_splat_total.clear();
+
+			human.swap();
+
+			// what the rest of the world sees is a smoothed copy, which takes out the speckle of single depth pixels
+			// (the human field itself stays unfiltered, so that the smoothing doesn't build up from frame to frame)
+			const float * humans = human.front();
+			if (human_filter_mode) {
+				if (human_filtered.empty()) {
+					human_filtered.resize(LAND_TEXELS);
+					human_filter_scratch.resize(LAND_TEXELS);
+				}
+				field2d_blur3<LAND_DIM>(workers, LAND_DIM, human.front(), &human_filtered[0], &human_filter_scratch[0], human_filter_mode == 2, human_filter_passes);
+				humans = &human_filtered[0];
+			}
+			human_published.publish(humans, LAND_TEXELS);
+			// NOW FLOW
+	#ifdef AL_WIN
+			if (1) {
+
+				// copy human to char arrays for CV:
+				for (int i=0; i<LAND_TEXELS; i++) {
+					humanchar0[i] = humanchar1[i];
+					humanchar1[i] = humans[i] * 255;
+				}
+				
+				int levels = 3; // default=5;
+				double pyr_scale = 0.5;
+				int winsize = 13;
+				int iterations = 3; // default = 10;
+				int poly_n = 5;
+				double poly_sigma = 1.2; // default = 1.1
+				int flags = 0;
+				
+				// create CV mat wrapper around Jitter matrix data
+				// (cv declares dim as numrows, numcols, i.e. dim1, dim0, or, height, width)
+				void * src;
+				cv::Mat prev(LAND_DIM, LAND_DIM, CV_8UC(1), (void *)humanchar0);
+				cv::Mat next(LAND_DIM, LAND_DIM, CV_8UC(1), (void *)humanchar1);
+				cv::Mat flow(LAND_DIM, LAND_DIM, CV_32FC(2), (void *)state->flow);
+				cv::calcOpticalFlowFarneback(prev, next, flow, pyr_scale, levels, winsize, iterations, poly_n, poly_sigma, flags);
+
+				const float smoothing = 1.f - powf(1.f - glm::clamp(flow_smoothing, 0.f, 1.f), elapsed * 30.f);
+				for (int i=0; i<LAND_TEXELS; i++) {
+					flowsmooth[i] += smoothing * (state->flow[i] - flowsmooth[i]);
+				}
+				flow_published.publish(flowsmooth, LAND_TEXELS);
+				
+			}
+	#endif
+
+			
+		}
+	}
+
+	// the masks that used to be applied inline, for a device that has no mask image:
+	// rectangles in depth pixels, and circles in the colour image
+	// unlike the inline test, which looked up each pixel in the frame's uv map, the circles are placed by the
+	// pixel geometry of the Kinect v2 (the uv map has no entry where there is no depth, and changes with the depth):
+	// both cameras are taken as pinholes sharing an axis, with fields of view of 70.6 x 60 degrees for depth
+	// and 84.1 x 53.8 for colour; ignoring the ~5cm between them shifts the circles' edges by up to ~6 depth pixels
+	// at 3m (less further away), so where that matters, paint a depthmask.pgm instead
+	void depth_mask_default(int k, DepthMask& mask) {
+		glm::vec2 kaspectnorm = 1.f/glm::vec2(float(cColorHeight)/float(cColorWidth), 1.f);
+		const float deg = float(M_PI/180.);
+		const glm::vec2 depth2colour(
+			tanf(0.5f*70.6f*deg) / tanf(0.5f*84.1f*deg),
+			tanf(0.5f*60.f*deg) / tanf(0.5f*53.8f*deg));
+		for (int i=0, y=0; y < DEPTH_HEIGHT; y++) {
+			for (int x=0; x < DEPTH_WIDTH; x++, i++) {
+				const glm::vec2 pixel((x + 0.5f)/DEPTH_WIDTH, (y + 0.5f)/DEPTH_HEIGHT);
+				const glm::vec2 uv = 0.5f + (pixel - 0.5f) * depth2colour;
+				bool masked = false;
+				if (k==1 && (x > DEPTH_WIDTH * 0.7 && y > DEPTH_WIDTH * 0.5)) masked = true;
+				if (k==1 && (x > DEPTH_WIDTH * 0.85)) masked = true;
+				if (k==0 && (y < DEPTH_HEIGHT * 0.3 && x > DEPTH_WIDTH * 0.75)) masked = true;
+				if (k==0 && glm::length((uv - glm::vec2(0.17f, 0.93f))* kaspectnorm) < 0.2f) masked = true;
+				if (k==0 && glm::length((uv - glm::vec2(0.57f, 0.8f))* kaspectnorm) < 0.15f) masked = true;
+				if (k==0 && glm::length((uv - glm::vec2(0.9f, 0.93f))* kaspectnorm) < 0.35f) masked = true;
+				mask.set(i, !masked);
+			}
+		}
+	}
+
+	void load_depth_masks();
+
 	void land_update(float dt) {
+		const float * humans = land_human.pin(human_published);
+		// the furthest any cell moved this tick:
+		float moved = 0.f;
 		for (int y=0; y<LAND_DIM; y++) {
 			for (int x=0; x<LAND_DIM; x++) {
 				auto land_idx = al_field2d_index_nowrap(land_dim2, x, y);
 
-				float h = human.front()[land_idx];
+				float h = humans[land_idx];
 				glm::vec4& landpt = land[land_idx];
 				//landpt.w = h;
 
@@ -1086,61 +1954,139 @@ struct State {
 					h1 = glm::mix(landpt.w, h, land_rise_rate * dt);
 				}
 
+				moved = glm::max(moved, fabsf(h1 - landpt.w));
 				landpt.w = h1;//glm::mix(landpt.w, h1, 0.2f);
 			}
 		}
 
+		// an upper bound on how far any cell has moved since the last bake, and since the fungus terrain was derived:
+		land_drift += moved;
+		fungus_terrain_drift += moved;
+		// (the land follows the human field wherever it is, so this also catches the human-land term changing)
+		if (fungus_terrain_drift * field2world_scale > fungus_terrain_threshold) {
+			fungus_terrain_drift = 0.f;
+			generate_fungus_terrain(humans);
+		}
+
 		// maybe diffuse too to smoothen land?
-		
-		// next, calculate normals
-		// THIS IS TOO SLOW!!!!
-		//generate_land_sdf_and_normals();
+	}
+
+	// re-bake the land's SDF, normals & fluid boundary, if the land may have moved since the last bake,
+	// or the parameters the boundary is baked with have changed
+	// (run by the land thread after land_update)
+	// the fluid boundary is baked into the back buffer, and handed to the fluid thread to swap in;
+	// until it has done so, the bake is put off, so that the fluid never reads a boundary being written
+	void land_bake() {
+		// only movements that the SDF could resolve need a new bake:
+		const bool moved = land_drift > land_bake_threshold;
+		const bool retuned = fluid_contour_follow != land_baked_contour_follow || fluid_active_height != land_baked_active_height;
+		if ((!moved && !retuned) || fluid_boundary_ready.load()) return;
+		if (moved) {
+			land_drift = 0.f;
+			generate_land_sdf_and_normals();
+		}
+		land_baked_contour_follow = fluid_contour_follow;
+		land_baked_active_height = fluid_active_height;
+		generate_fluid_boundary(fluid_velocities.dim(), fluid_boundary.back(), fluid_brick_land_back());
+		fluid_boundary_ready.store(1);
+	}
+
+	// the land bricks that go with fluid_boundary.front() & back():
+	uint8_t * fluid_brick_land_front() { return fluid_brick_land[fluid_boundary.isSwapped ? 1 : 0]; }
+	uint8_t * fluid_brick_land_back() { return fluid_brick_land[fluid_boundary.isSwapped ? 0 : 1]; }
+
+	// (fluid thread) swap in a boundary (and its land bricks) that the land thread has baked, if there is one
+	void fluid_take_boundary() {
+		if (!fluid_boundary_ready.load()) return;
+		fluid_boundary.swap();
+		fluid_boundary_ready.store(0);
 	}
 
 	void generate_land_sdf_and_normals() {
 		{
 			// generate SDF from land height:
-			int i=0;
-			for (size_t z=0;z<SDF_DIM;z++) {
-				for (size_t y=0;y<SDF_DIM;y++) {
-					for (size_t x=0;x<SDF_DIM;x++) {
-						glm::vec3 coord = glm::vec3(x, y, z);
-						glm::vec3 norm = coord/glm::vec3(SDF_DIM);
-						glm::vec2 norm2 = glm::vec2(norm.x, norm.z);
-						
-						//int ii = al_field2d_index(dim2, glm::ivec2(x, z));
-						//float w = land[ ii ].w;
-						float w = al_field2d_readnorm_interp(land_dim2, land, norm2).w;
-
-						distance[i] = norm.y < w ? -1. : 1.;
-						distance_binary[i] = distance[i] < 0.f ? 0.f : 1.f;
-
-						i++;
+			workers.parallel_for(0, SDF_DIM, [&](int z0, int z1) {
+				for (int z=z0; z<z1; z++) {
+					for (int y=0, i=z*SDF_DIM*SDF_DIM; y<SDF_DIM; y++) {
+						for (int x=0; x<SDF_DIM; x++, i++) {
+							glm::vec3 coord = glm::vec3(x, y, z);
+							glm::vec3 norm = coord/glm::vec3(SDF_DIM);
+							glm::vec2 norm2 = glm::vec2(norm.x, norm.z);
+							
+							//int ii = al_field2d_index(dim2, glm::ivec2(x, z));
+							//float w = land[ ii ].w;
+							float w = al_field2d_readnorm_interp(land_dim2, land, norm2).w;
+
+							distance[i] = norm.y < w ? -1. : 1.;
+							distance_binary[i] = distance[i] < 0.f ? 0.f : 1.f;
+						}
 					}
 				}
-			}
+			});
 			sdf_from_binary(sdf_dim, distance_binary, distance);
 			//sdf_from_binary_deadreckoning(land_dim, distance_binary, distance);
-			al_field3d_scale(sdf_dim, distance, 1.f/(SDF_DIM));
+			workers.parallel_for(0, SDF_DIM, [&](int z0, int z1) {
+				field3d_scale_slab(sdf_dim, distance, 1.f/(SDF_DIM), z0, z1);
+			});
 		}
 
 		// generate land normals:
-		int i=0;
 		glm::ivec2 dim2 = glm::ivec2(LAND_DIM, LAND_DIM);
-		for (size_t y=0;y<dim2.y;y++) {
-			for (size_t x=0;x<dim2.x;x++, i++) {
-				glm::vec2 coord = glm::vec2(x, y);
-				glm::vec2 norm = coord/glm::vec2(dim2);
-				glm::vec2 snorm = norm*2.f-1.f;
+		workers.parallel_for(0, dim2.y, [&](int y0, int y1) {
+			for (int y=y0; y<y1; y++) {
+				for (int x=0, i=y*dim2.x; x<dim2.x; x++, i++) {
+					glm::vec2 coord = glm::vec2(x, y);
+					glm::vec2 norm = coord/glm::vec2(dim2);
 
-				float w = land[i].w;
+					float w = land[i].w;
 
-				glm::vec3 norm3 = glm::vec3(norm.x, w, norm.y);
+					glm::vec3 norm3 = glm::vec3(norm.x, w, norm.y);
 
-				glm::vec3 normal = sdf_field_normal4(sdf_dim, distance, norm3, 1.f/SDF_DIM);
-				land[i] = glm::vec4(normal, w);
+					glm::vec3 normal = sdf_field_normal4(sdf_dim, distance, norm3, 1.f/SDF_DIM);
+					land[i] = glm::vec4(normal, w);
+				}
 			}
-		}
+		});
+	}
+
+	// bake the land's influence on each fluid voxel of a grid of size dim
+	// so that fluid_update doesn't need to sample the SDF at all
+	// also marks which bricks of the grid lie near the land surface
+	void generate_fluid_boundary(const glm::ivec3 dim, FluidBoundary * boundary, uint8_t * bricks) {
+		const glm::vec3 field_dimf = glm::vec3(dim);
+		// s is the amount of dist where the influence is 50%
+		const float s = fluid_contour_follow;
+		memset(bricks, 0, field3d_brick_count(dim));
+		// split by layers of bricks, so that no two tasks mark the same brick:
+		const int layers = field_bricks(dim.z);
+		workers.parallel_for(0, layers, [&](int l0, int l1) {
+			for (int z = l0*FIELD_BRICK; z<glm::min(l1*FIELD_BRICK, dim.z); z++) {
+				for (int y = 0; y<dim.y; y++) {
+					for (int x = 0, i = (z*dim.y + y)*dim.x; x<dim.x; x++, i++) {
+						// get norm'd coordinate:
+						glm::vec3 norm = glm::vec3(x,y,z) / field_dimf;
+
+						// use this to sample the landscape:
+						float sdist;
+						al_field3d_readnorm_interp(sdf_dim, distance, norm, &sdist);
+						float dist = fabsf(sdist);
+
+						FluidBoundary& b = boundary[i];
+						// get a normal for the land:
+						// TODO: or read from state->land xyz?
+						b.normal = sdf_field_normal4(sdf_dim, distance, norm, 1.f/SDF_DIM);
+						// generate a normalized influence factor -- the closer we are to the surface, the greater this is
+						//b.influence = glm::smoothstep(0.05f, 0.f, dist);
+						b.influence = s / (s + dist);
+						b.underground = sdist < 0.f;
+
+						if (!b.underground && sdist < fluid_active_height) {
+							bricks[field3d_brick_index(dim, x, y, z)] = 1;
+						}
+					}
+				}
+			}
+		});
 	}
 
 
@@ -1291,13 +2237,12 @@ struct State {
 				a.color += dt * (glm::vec3(grey) - a.color);
 
 				// deposit blood:
-				al_field2d_addnorm_interp(fungus_dim, chemical_field.front(), norm2, decay * blood_color);
+				sim_chemical_deposits.push_back({ norm2, decay * blood_color });
 			}
 		}
 		//console.log("%d deaths, %d recycles, %d births", deathcount, recyclecount, birthcount);
 	}
 	void creature_alive_update(Creature& o, float dt) {
-		float idt = 1.f/dt;
 		// float daylight_factor = sin(daytime + 1.5 * a.pos.x) * 0.4 + 0.6; // 0.2 ... 1
 
 
@@ -1357,10 +2302,9 @@ struct State {
 		// get fluid flow:
 		//glm::vec3 flow;
 		//fluid.velocities.front().readnorm(norm, &flow.x);
-		glm::vec3 fluid = al_field3d_readnorm_interp(field_dim, fluid_velocities.front(), norm);
+		glm::vec3 fluid = al_field3d_readnorm_interp(fluid_dim, sim_fluid.data(), norm);
 		// convert to meters per second:
-		// (why is this needed? shouldn't it be m/s already?)
-		fluid *= idt;
+		fluid *= fluid_world_speed;
 
 		// NEIGHBOUR SEARCH:
 		// how far in the future want to focus attention?
@@ -1400,8 +2344,8 @@ struct State {
 			glm::vec3 chem = food_color * o.ant.food
 				+ nest_color * o.ant.nestness;
 			// add to land, add to emission:
-			al_field2d_addnorm_interp(fungus_dim, chemical_field.front(), norm2, chem * dt);
-			al_field3d_addnorm_interp(field_dim, emission_field.back(), norm, chem * dt * emission_scale);
+			sim_chemical_deposits.push_back({ norm2, chem * dt });
+			sim_emission_deposits.push_back({ norm, chem * dt * emission_scale });
 
 			auto nest = island_centres[o.ant.nest_idx];
 			// cheat
@@ -1432,19 +2376,19 @@ struct State {
 					//-- look for nest:
 					auto normp1 = transform(world2field, a1);
 					auto normp2 = transform(world2field, a2);
-					float p1 = al_field2d_readnorm_interp(fungus_dim, chemical_field.back(), glm::vec2(normp1.x, normp1.z)).z;
-					float p2 = al_field2d_readnorm_interp(fungus_dim, chemical_field.back(), glm::vec2(normp2.x, normp2.z)).z;
+					float p1 = al_field2d_readnorm_interp(fungus_dim, sim_chemicals.data(), glm::vec2(normp1.x, normp1.z)).z;
+					float p2 = al_field2d_readnorm_interp(fungus_dim, sim_chemicals.data(), glm::vec2(normp2.x, normp2.z)).z;
 					console.log("sniff nest %f %f", p1, p2);
 					ant_sniff_turn(o, p1, p2);
 				}
 			} else {
 				// look for food (blood)
-				float f = al_field2d_readnorm_interp(fungus_dim, chemical_field.back(), norm2).x;
+				float f = al_field2d_readnorm_interp(fungus_dim, sim_chemicals.data(), norm2).x;
 				if (f > ant_food_min) {
 					//sounds.ant_food(a)	
 					// remove it:
 					f = glm::clamp(f, 0.f, 1.f);
-					al_field2d_addnorm_interp(fungus_dim, chemical_field.back(), norm2, glm::vec3(-f, 0.f, 0.f));
+					sim_chemical_deposits.push_back({ norm2, glm::vec3(-f, 0.f, 0.f) });
 					o.ant.food += f;
 					//a.vel = -a.vel;
 					o.health = 1;
@@ -1453,8 +2397,8 @@ struct State {
 					// look for food:
 					auto normp1 = transform(world2field, a1);
 					auto normp2 = transform(world2field, a2);
-					float p1 = al_field2d_readnorm_interp(fungus_dim, chemical_field.back(), glm::vec2(normp1.x, normp1.z)).y;
-					float p2 = al_field2d_readnorm_interp(fungus_dim, chemical_field.back(), glm::vec2(normp2.x, normp2.z)).y;
+					float p1 = al_field2d_readnorm_interp(fungus_dim, sim_chemicals.data(), glm::vec2(normp1.x, normp1.z)).y;
+					float p2 = al_field2d_readnorm_interp(fungus_dim, sim_chemicals.data(), glm::vec2(normp2.x, normp2.z)).y;
 					
 					//DPRINT("%f %f", p1, p2);
 					
@@ -1468,13 +2412,12 @@ struct State {
 		case Creature::TYPE_BOID: {
 
 			// SENSE FUNGUS
-			size_t fungus_idx = al_field2d_index_norm(fungus_dim, norm2);
 			//float fungal = fungus_field.front()[fungus_idx];
-			float fungal = al_field2d_readnorm_interp(fungus_dim, fungus_field.front(), norm2);
+			float fungal = al_field2d_readnorm_interp(fungus_dim, sim_fungus.data(), norm2);
 			//if(i == objectSel) console.log("fungal %f", fungal);
 			float eat = glm::max(0.f, fungal) * fungus_to_boid_transfer;
 			//al_field2d_addnorm_interp(fungus_dim, fungus_field.front(), norm2, -eat);
-			fungus_field.front()[fungus_idx] -= eat;
+			sim_fungus_deposits.push_back({ norm2, eat });
 
 			o.color = glm::vec3(o.params) * 0.75f + 0.25f;
 
@@ -1747,7 +2690,7 @@ struct State {
 		//glm::vec3 push = quat_uf(o.orientation) * (creature_fluid_push * (float)dt);
 		glm::vec3 push = o.velocity * (creature_fluid_push * (float)dt);
 		//fluid.velocities.front().addnorm(norm, &push.x);
-		al_field3d_addnorm_interp(field_dim, fluid_velocities.front(), norm, push);
+		sim_fluid_deposits.push_back({ norm, push });
 
 		
 	}
@@ -1785,6 +2728,7 @@ struct State {
 	}
 
 	void update_projector_loc();
+	void update_depth_device(int k);
 
 	inline float ant_sniff_turn(Creature& a, float p1, float p2) {
 		//-- is there any pheromone near?
@@ -0,0 +1,131 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <deque>
+
+/*
+	A small pool of worker threads, shared by the simulation threads for their data-parallel passes.
+
+	parallel_for() splits a range into contiguous chunks (z-slabs, row bands, tiles...),
+	hands them out to the pool, and the calling thread works on them too until all are done.
+	Several threads (fluidThread, fieldThread, ...) may call parallel_for() at the same time;
+	their jobs just queue up and are served in order.
+*/
+struct WorkerPool {
+	// a kernel processes the sub-range [begin, end)
+	typedef std::function<void(int, int)> Kernel;
+
+	struct Job {
+		const Kernel * kernel;
+		int begin, end;
+		int chunks;		///< how many pieces the range is split into
+		int next;		///< the next chunk to hand out
+		int remaining;	///< chunks not yet completed
+
+		void range(int chunk, int& b, int& e) const {
+			int64_t len = end - begin;
+			b = begin + int(len * chunk / chunks);
+			e = begin + int(len * (chunk+1) / chunks);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	std::deque<Job *> jobs;
+	std::mutex mutex;
+	std::condition_variable job_added, job_done;
+	bool stopping = false;
+
+	~WorkerPool() { stop(); }
+
+	// number of background threads (the caller of parallel_for is an extra one)
+	int size() const { return int(threads.size()); }
+
+	// how many threads may work on a parallel_for at once
+	int concurrency() const { return size() + 1; }
+
+	void start(int numthreads) {
+		stop();
+		stopping = false;
+		for (int i=0; i<numthreads; i++) {
+			threads.push_back(std::thread(&WorkerPool::run, this));
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		job_added.notify_all();
+		for (auto& t : threads) t.join();
+		threads.clear();
+	}
+
+	// run kernel over [begin, end), split into `tasks` chunks (default: one per thread)
+	// returns when all chunks are complete
+	void parallel_for(int begin, int end, const Kernel& kernel, int tasks=0) {
+		int len = end - begin;
+		if (len <= 0) return;
+		if (tasks <= 0) tasks = concurrency();
+		tasks = std::min(tasks, len);
+		if (tasks == 1 || threads.empty()) {
+			for (int i=0; i<tasks; i++) {
+				int b = begin + int(int64_t(len) * i / tasks);
+				int e = begin + int(int64_t(len) * (i+1) / tasks);
+				kernel(b, e);
+			}
+			return;
+		}
+
+		Job job;
+		job.kernel = &kernel;
+		job.begin = begin;
+		job.end = end;
+		job.chunks = tasks;
+		job.next = 0;
+		job.remaining = tasks;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.push_back(&job);
+		job_added.notify_all();
+		// help out until every chunk has been handed out:
+		while (job.next < job.chunks) {
+			work(lock, &job);
+		}
+		// then wait for the stragglers:
+		job_done.wait(lock, [&]{ return job.remaining == 0; });
+	}
+
+	// claim & run one chunk of job (lock must be held on entry, and is held again on return)
+	void work(std::unique_lock<std::mutex>& lock, Job * job) {
+		int chunk = job->next++;
+		if (job->next >= job->chunks) {
+			// fully handed out, so retire it from the queue:
+			jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+		}
+		int b, e;
+		job->range(chunk, b, e);
+		lock.unlock();
+		(*job->kernel)(b, e);
+		lock.lock();
+		if (--job->remaining == 0) job_done.notify_all();
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (1) {
+			job_added.wait(lock, [&]{ return stopping || !jobs.empty(); });
+			if (stopping) return;
+			work(lock, jobs.front());
+		}
+	}
+};
+
+#endif // WORKERS_H